@@ -0,0 +1,161 @@
+#pragma once
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstdint>
+
+#include <opencv2/opencv.hpp>
+
+#include "BlockMatching.hpp"
+#include "Utils.hpp"
+#include "Timer.hpp"
+
+namespace Benchmark {
+	//Where a search window starts and whether candidates outside the frame are skipped, to count the candidates an
+	//engine evaluates per block. FromClosest and Full are the windows of FullExhastiveSAD/ADS and NaiveFullExhastive,
+	//the other two are those of the full_exhastive_test and motion_estimation_opt kernels
+	enum class Window { FromClosest, Full, FromClosestUnchecked, Inclusive };
+
+	struct Result {
+		std::string engine;
+		int blockSize = 0, stepSize = 0, blocks = 0, runs = 0;
+
+		//Candidates evaluated for every block of one frame pair and the median time of matching it. fullCandidates are
+		//those of the exhaustive search of the same grid, which only differ for engines that prune or skip candidates
+		long long candidates = 0, fullCandidates = 0;
+		double ns = 0;
+
+		double NsPerBlock() const {
+			return this->blocks > 0 ? this->ns / this->blocks : 0;
+		};
+
+		double CandidatesPerSecond() const {
+			return this->ns > 0 ? this->candidates / (this->ns / NANO) : 0;
+		};
+	};
+
+	//Texture of a frame at (x, y): smooth waves so a block has one clear best match nearby, and hashed noise so flat
+	//regions don't tie. Frames are made from it rather than drawn at random so a shifted frame has exactly the same pixels
+	inline uchar Texture(int x, int y) {
+		uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u;
+		h ^= h >> 13;
+		h *= 0x5bd1e995u;
+		h ^= h >> 15;
+
+		double value = 128 + 50 * std::sin(0.21 * x + 0.13 * y) + 40 * std::cos(0.17 * y - 0.05 * x) + (int)(h & 31) - 16;
+		return (uchar)std::max(0.0, std::min(255.0, value));
+	}
+
+	//Fixed pair of 8 bit gray frames, curr is prev moved by shift so every engine has the same motion to find
+	inline void SyntheticFrames(cv::Mat& prev, cv::Mat& curr, int width, int height, cv::Point shift) {
+		prev.create(height, width, CV_8UC1);
+		curr.create(height, width, CV_8UC1);
+
+		for (int y = 0; y < height; y++) {
+			uchar * p = prev.ptr<uchar>(y), * c = curr.ptr<uchar>(y);
+
+			for (int x = 0; x < width; x++) {
+				p[x] = Texture(x, y);
+				c[x] = Texture(x - shift.x, y - shift.y);
+			}
+		}
+	}
+
+	//Candidates evaluated for every block of a wB x hB grid, window is the search window of the engine
+	inline long long CountCandidates(int width, int height, int blockSize, int stepSize, int wB, int hB, Window window) {
+		const int sWindow = blockSize;
+		long long count = 0;
+
+		for (int x = 0; x < wB; x++) {
+			for (int y = 0; y < hB; y++) {
+				const cv::Point currPoint(x * stepSize, y * stepSize);
+
+				if (window == Window::Inclusive) {
+					count += (long long)(2 * sWindow + 1) * (2 * sWindow + 1);
+					continue;
+				}
+
+				const cv::Point start = window == Window::Full ? cv::Point(-sWindow, -sWindow)
+					: BlockMatching::ClosestInBoundsOffset(currPoint, sWindow, width, height, blockSize);
+
+				if (window == Window::FromClosestUnchecked) {
+					count += (long long)(sWindow - start.x) * (sWindow - start.y);
+					continue;
+				}
+
+				for (int row = start.x; row < sWindow; row++)
+					for (int col = start.y; col < sWindow; col++)
+						if (BlockMatching::IsInBounds(currPoint.x + row, currPoint.y + col, width, height, blockSize))
+							count++;
+			}
+		}
+
+		return count;
+	}
+
+	//Median time of run() in ns. It is run once to warm caches and lazily built state, then until minSeconds have
+	//passed and it has run at least minRuns times
+	inline double Measure(const std::function<void()>& run, double minSeconds, int minRuns, int& runs) {
+		std::vector<long long int> samples;
+		Timer total, timer;
+
+		run();
+		total.tic();
+
+		while ((int)samples.size() < minRuns || total.getElapsed() < minSeconds * NANO) {
+			timer.tic();
+			run();
+			samples.push_back(timer.getElapsed());
+		}
+
+		runs = (int)samples.size();
+		std::sort(samples.begin(), samples.end());
+		return (double)samples[samples.size() / 2];
+	}
+
+	//Block sizes getBlockSizes gives for the frame with a step size, 1 has no step size smaller than itself
+	inline std::vector<int> GetBlockSizes(int width, int height, int only = 0) {
+		std::vector<int> sizes, all = Util::getBlockSizes(width, height);
+		std::sort(all.begin(), all.end());
+
+		for (size_t i = 0; i < all.size(); i++)
+			if (all[i] > 1 && (only <= 0 || all[i] == only))
+				sizes.push_back(all[i]);
+
+		return sizes;
+	}
+
+	inline void PrintHeader(std::ostream& out) {
+		out << std::left << std::setw(24) << "engine" << std::right << std::setw(7) << "block" << std::setw(6) << "step"
+			<< std::setw(8) << "blocks" << std::setw(12) << "cand/block" << std::setw(12) << "full/block" << std::setw(6) << "runs" << std::setw(14) << "ns/block"
+			<< std::setw(14) << "Mcand/s" << std::endl;
+	}
+
+	inline void PrintResult(std::ostream& out, const Result& result) {
+		std::ios::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+
+		out << std::left << std::setw(24) << result.engine << std::right << std::setw(7) << result.blockSize << std::setw(6) << result.stepSize
+			<< std::setw(8) << result.blocks << std::setw(12) << (result.blocks > 0 ? result.candidates / result.blocks : 0)
+			<< std::setw(12) << (result.blocks > 0 ? result.fullCandidates / result.blocks : 0) << std::setw(6) << result.runs
+			<< std::fixed << std::setprecision(1) << std::setw(14) << result.NsPerBlock() << std::setw(14) << result.CandidatesPerSecond() / 1e6 << std::endl;
+
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+	//Tab separated like the results files, one line per engine and block size
+	inline void WriteResults(std::ostream& out, const std::vector<Result>& results) {
+		out << "engine\tblock\tstep\tblocks\tcandidates\tfull_candidates\truns\tns\tns_per_block\tcandidates_per_second" << std::endl;
+
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result& r = results[i];
+			out << r.engine << "\t" << r.blockSize << "\t" << r.stepSize << "\t" << r.blocks << "\t" << r.candidates << "\t" << r.fullCandidates << "\t" << r.runs
+				<< "\t" << (long long)r.ns << "\t" << r.NsPerBlock() << "\t" << r.CandidatesPerSecond() << std::endl;
+		}
+	}
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(__APPLE__) || defined(__MACOSX)
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+#include <opencv2/opencv.hpp>
+
+#include "Benchmark.hpp"
+
+namespace Benchmark {
+	//First CPU device of any platform, the first device of any type if there is no CPU runtime. False without OpenCL
+	inline bool FindDevice(cl::Device& device) {
+		std::vector<cl::Platform> platforms;
+		cl::Platform::get(&platforms);
+
+		bool found = false;
+
+		for (size_t i = 0; i < platforms.size(); i++) {
+			std::vector<cl::Device> devices;
+			platforms[i].getDevices((cl_device_type)CL_DEVICE_TYPE_ALL, &devices);
+
+			for (size_t j = 0; j < devices.size(); j++) {
+				if (devices[j].getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU) {
+					device = devices[j];
+					return true;
+				}
+
+				if (!found) {
+					device = devices[j];
+					found = true;
+				}
+			}
+		}
+
+		return found;
+	}
+
+	//Times the kernels of kernels.cl on a fixed frame pair. Frames are uploaded once, only the kernel's own execution is
+	//measured, from the profiling info of its event, so host overhead and transfers are not part of ns/block.
+	class KernelBenchmark {
+	public:
+		KernelBenchmark(const cl::Context& context, const cl::Device& device, const cl::Program& program, const cv::Mat& prev, const cv::Mat& curr)
+			: context(context), queue(context, device, CL_QUEUE_PROFILING_ENABLE), program(program) {
+			this->width = curr.cols;
+			this->height = curr.rows;
+
+			cl::ImageFormat fmt(CL_INTENSITY, CL_UNSIGNED_INT8);
+			this->prevImage = cl::Image2D(context, CL_MEM_READ_ONLY, fmt, this->width, this->height);
+			this->currImage = cl::Image2D(context, CL_MEM_READ_ONLY, fmt, this->width, this->height);
+
+			cl::size_t<3> origin, region;
+			region[0] = this->width;
+			region[1] = this->height;
+			region[2] = 1;
+
+			this->queue.enqueueWriteImage(this->prevImage, CL_TRUE, origin, region, prev.step, 0, prev.data);
+			this->queue.enqueueWriteImage(this->currImage, CL_TRUE, origin, region, curr.step, 0, curr.data);
+		};
+
+		//Names of the kernels Run() knows the arguments of
+		static std::vector<std::string> GetKernelNames() {
+			return { "full_exhastive_SAD", "full_exhastive_ADS", "full_exhastive_test", "motion_estimation_opt" };
+		};
+
+		Result Run(const std::string& name, int blockSize, double minSeconds, int minRuns) {
+			cl::Kernel kernel(this->program, name.c_str());
+
+			//motion_estimation_opt has no step size, its blocks don't overlap and it searches the inclusive window
+			const bool opt = name == "motion_estimation_opt";
+			const int stepSize = opt ? blockSize : Util::getStepSize(blockSize);
+			const cv::Size grid = opt ? cv::Size(this->width / blockSize, this->height / blockSize) : Util::getBlockGrid(this->width, this->height, blockSize, stepSize);
+			const int count = grid.area();
+
+			//Vectors as int2 and details as float2 are 8 bytes a block, as are dx and dy together
+			cl::Buffer a(this->context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * 2 * count);
+			cl::Buffer b(this->context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * 2 * count);
+			cl::Buffer c(this->context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * count);
+			Window window;
+
+			int arg = 0;
+			kernel.setArg(arg++, this->prevImage);
+			kernel.setArg(arg++, this->currImage);
+
+			if (!opt)
+				kernel.setArg(arg++, stepSize);
+
+			kernel.setArg(arg++, blockSize);
+			kernel.setArg(arg++, this->width);
+			kernel.setArg(arg++, this->height);
+			kernel.setArg(arg++, a);
+
+			if (name == "full_exhastive_test") {
+				kernel.setArg(arg++, b);
+				window = Window::FromClosestUnchecked;
+			}
+			else if (opt) {
+				window = Window::Inclusive;
+			}
+			else {
+				kernel.setArg(arg++, b);
+				kernel.setArg(arg++, c);
+				window = name == "full_exhastive_SAD" ? Window::Full : Window::FromClosest;
+			}
+
+			Result result;
+			result.engine = name;
+			result.blockSize = blockSize;
+			result.stepSize = stepSize;
+			result.blocks = count;
+			result.candidates = result.fullCandidates = CountCandidates(this->width, this->height, blockSize, stepSize, grid.width, grid.height, window);
+
+			if (count == 0)
+				return result;
+
+			cl::NDRange global((size_t)grid.width, (size_t)grid.height, 1);
+			std::vector<long long int> samples;
+			Timer total;
+
+			//The first launch is left out as it may include compiling the kernel for the device
+			for (int i = 0; i <= minRuns || total.getElapsed() < minSeconds * NANO; i++) {
+				if (i == 1)
+					total.tic();
+
+				cl::Event event;
+				this->queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, cl::NullRange, NULL, &event);
+				event.wait();
+
+				if (i > 0)
+					samples.push_back((long long int)(event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>()));
+			}
+
+			std::sort(samples.begin(), samples.end());
+			result.runs = (int)samples.size();
+			result.ns = (double)samples[samples.size() / 2];
+			return result;
+		};
+	private:
+		cl::Context context;
+		cl::CommandQueue queue;
+		cl::Program program;
+		cl::Image2D prevImage, currImage;
+		int width, height;
+	};
+}
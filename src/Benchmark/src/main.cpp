@@ -0,0 +1,232 @@
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#define __CL_ENABLE_EXCEPTIONS
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include <opencv2/opencv.hpp>
+
+#include "Benchmark.hpp"
+#include "Engine.hpp"
+#include "FrameSource.hpp"
+#include "MotionField.hpp"
+#include "Options.hpp"
+
+#ifdef USE_OPENCL
+#include "KernelBenchmark.hpp"
+#endif
+
+//Times every matching engine for every block size of a fixed frame pair. The pair is synthetic (--size) unless --input
+//gives a video, of which the first two frames of the ROI are used. --block and --engine restrict the run to one block
+//size or engine, --output also writes the results tab separated.
+int main(int argc, char **argv)
+{
+	std::string kernelFile = "kernels.cl";
+
+#ifdef KERNEL_FILE
+	kernelFile = KERNEL_FILE;
+#endif
+
+	Options options(argc, argv);
+	int width = 160, height = 120, minRuns = 3;
+	double minSeconds = 0.2;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "--size") == 0) && (i < (argc - 1)))
+		{
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+			{
+				std::cerr << "Expected --size <width>x<height>" << std::endl;
+				return 1;
+			}
+		}
+		else if ((strcmp(argv[i], "--time") == 0) && (i < (argc - 1)))
+		{
+			minSeconds = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--help") == 0)
+		{
+			std::cerr << "\t--size <width>x<height> : Size of the synthetic frame pair used without --input. Defaults to 160x120." << std::endl;
+			std::cerr << "\t--time <seconds> : Least time each engine and block size is run for, the median run is reported. Defaults to 0.2." << std::endl;
+			return 0;
+		}
+	}
+
+	//Fixed frame pair, the synthetic one moves by a known displacement
+	cv::Mat prev, curr;
+
+	if (!options.input.empty()) {
+		std::unique_ptr<FrameSource> source = FrameSource::Open(options.input, false);
+		if (!source)
+			return 1;
+
+		FramePairs frames(*source, options.roi);
+		if (!frames.Next() || !frames.Next()) {
+			std::cerr << "Need two frames of " << options.input << std::endl;
+			return 1;
+		}
+
+		frames.Prev().copyTo(prev);
+		frames.Curr().copyTo(curr);
+		width = curr.cols;
+		height = curr.rows;
+	}
+	else {
+		Benchmark::SyntheticFrames(prev, curr, width, height, cv::Point(2, 1));
+	}
+
+	std::vector<int> bSizes = Benchmark::GetBlockSizes(width, height, options.blockSize);
+	if (bSizes.empty()) {
+		std::cerr << "No block size divides " << width << "x" << height << (options.blockSize > 0 ? " as --block" : "") << std::endl;
+		return 1;
+	}
+
+	std::cout << "Frames: " << width << "x" << height << std::endl;
+	Benchmark::PrintHeader(std::cout);
+
+	std::vector<Benchmark::Result> results;
+
+	auto selected = [&](const std::string& name) {
+		return options.engine.empty() || options.engine == name;
+	};
+
+	auto report = [&](const Benchmark::Result& result) {
+		results.push_back(result);
+		Benchmark::PrintResult(std::cout, result);
+	};
+
+	//Engines of the Sequential application by their --engine names, single threaded. Engines that prune or skip candidates
+	//report the ones they evaluated, next to those of the full search they replace
+	const char * engine_names[] = { "sad", "ads", "ssd", "sea", "tss", "ntss", "diamond", "hexagon", "pyramid", "predictive" };
+
+	for (size_t b = 0; b < bSizes.size(); b++) {
+		const int blockSize = bSizes[b], stepSize = Util::getStepSize(blockSize);
+		const cv::Size grid = Util::getBlockGrid(width, height, blockSize, stepSize);
+		const cv::Size naive_grid = Util::getBlockGrid(width, height, blockSize, blockSize);
+		const long long candidates = Benchmark::CountCandidates(width, height, blockSize, stepSize, grid.width, grid.height, Benchmark::Window::FromClosest);
+
+		//The original interface, allocating a field and copying it out on every call
+		std::vector<cv::Point> vectors(std::max(grid.area(), naive_grid.area()));
+		std::vector<cv::Point2f> details(vectors.size());
+		cv::Point * motionVectors = vectors.data();
+		cv::Point2f * motionDetails = details.data();
+
+		auto host = [&](const std::string& name, const cv::Size& g, int step, Benchmark::Window window, const std::function<void()>& run) {
+			if (!selected(name) || g.area() == 0)
+				return;
+
+			Benchmark::Result result;
+			result.engine = name;
+			result.blockSize = blockSize;
+			result.stepSize = step;
+			result.blocks = g.area();
+			result.candidates = result.fullCandidates = Benchmark::CountCandidates(width, height, blockSize, step, g.width, g.height, window);
+			result.ns = Benchmark::Measure(run, minSeconds, minRuns, result.runs);
+			report(result);
+		};
+
+		host("FullExhastiveSAD", grid, stepSize, Benchmark::Window::FromClosest, [&]() {
+			BlockMatching::FullExhastiveSAD(curr, prev, motionVectors, motionDetails, blockSize, stepSize, width, height, grid.width, grid.height);
+		});
+
+		host("FullExhastiveADS", grid, stepSize, Benchmark::Window::FromClosest, [&]() {
+			BlockMatching::FullExhastiveADS(curr, prev, motionVectors, motionDetails, blockSize, stepSize, width, height, grid.width, grid.height);
+		});
+
+		host("NaiveFullExhastive", naive_grid, blockSize, Benchmark::Window::Full, [&]() {
+			BlockMatching::NaiveFullExhastive(curr, prev, motionVectors, blockSize, width, height, naive_grid.width, naive_grid.height);
+		});
+
+		for (size_t e = 0; e < sizeof(engine_names) / sizeof(engine_names[0]); e++) {
+			if (!selected(engine_names[e]) || grid.area() == 0)
+				continue;
+
+			BlockMatching::Engine engine;
+			engine.Select(engine_names[e]);
+			MotionField field(grid.width, grid.height, blockSize, stepSize);
+
+			Benchmark::Result result;
+			result.engine = std::string("engine ") + engine_names[e];
+			result.blockSize = blockSize;
+			result.stepSize = stepSize;
+			result.blocks = grid.area();
+			result.fullCandidates = candidates;
+
+			//Engines keeping state from the previous pair start afresh every run, as after a seek, so every run evaluates
+			//the same candidates
+			long long evaluations = -1;
+			result.ns = Benchmark::Measure([&]() {
+				engine.Reset();
+				evaluations = engine.Match(nullptr, curr, prev, field, width, height);
+			}, minSeconds, minRuns, result.runs);
+
+			result.candidates = evaluations >= 0 ? evaluations : candidates;
+
+			report(result);
+		}
+	}
+
+#ifdef USE_OPENCL
+	try {
+		cl::Device device;
+
+		if (!Benchmark::FindDevice(device)) {
+			std::cerr << "No OpenCL device, kernels are not timed" << std::endl;
+		}
+		else {
+			std::cout << "OpenCL: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+
+			std::ifstream kFile(kernelFile);
+			if (!kFile.good())
+				throw std::runtime_error("Kernel File (" + kernelFile + ") does not exist/you do not have access.");
+
+			std::string kernels((std::istreambuf_iterator<char>(kFile)), std::istreambuf_iterator<char>());
+
+			cl::Context context({ device });
+			cl::Program::Sources sources(1, std::make_pair(kernels.c_str(), kernels.length() + 1));
+			cl::Program program(context, sources);
+
+			try {
+				program.build({ device });
+			}
+			catch (cl::Error err) {
+				std::cerr << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+				throw err;
+			}
+
+			Benchmark::KernelBenchmark kernel_benchmark(context, device, program, prev, curr);
+			std::vector<std::string> kernel_names = Benchmark::KernelBenchmark::GetKernelNames();
+
+			for (size_t b = 0; b < bSizes.size(); b++)
+				for (size_t k = 0; k < kernel_names.size(); k++)
+					if (selected(kernel_names[k]))
+						report(kernel_benchmark.Run(kernel_names[k], bSizes[b], minSeconds, minRuns));
+		}
+	}
+	catch (cl::Error err) {
+		std::cerr << "ERROR: " << err.what() << " (" << err.err() << "), kernels are not timed" << std::endl;
+	}
+	catch (std::exception& err) {
+		std::cerr << "ERROR: " << err.what() << ", kernels are not timed" << std::endl;
+	}
+#endif
+
+	if (!options.output.empty()) {
+		std::ofstream out(options.output);
+		Benchmark::WriteResults(out, results);
+
+		if (!out.good()) {
+			std::cerr << "Could not write " << options.output << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <utility>
+
+#if defined(__APPLE__) || defined(__MACOSX)
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+#include <opencv2/opencv.hpp>
+
+#include "MotionField.hpp"
+#include "Timer.hpp"
+
+//Matching kernels on a command queue of their own, one per match stage so several frame pairs can be on the device at
+//once. Frames live in device images between calls and the image holding the current frame becomes the previous frame of
+//the next pair when it is consecutive, so only one frame is uploaded per pair. Result buffers follow the block count.
+//
+//Given StageTimers the queue is made with profiling and the device time of the uploads, the kernel and the reads of
+//every pair is recorded from their events once the blocking reads have returned, so timing adds no waits.
+class DeviceMatcher {
+public:
+	//Methods: 0 SAD, 1 ADS
+	DeviceMatcher(const cl::Context& context, const cl::Program& program, int width, int height, StageTimers * latency = NULL)
+		: context(context), queue(context, latency ? CL_QUEUE_PROFILING_ENABLE : 0) {
+		this->latency = latency;
+
+		this->kernels[0] = cl::Kernel(program, "full_exhastive_SAD");
+		this->kernels[1] = cl::Kernel(program, "full_exhastive_ADS");
+
+		//CL_INTENSITY = uint4(I,I,I,I) and CL_UNSIGNED_INT8 for read_imageui
+		cl::ImageFormat fmt(CL_INTENSITY, CL_UNSIGNED_INT8);
+		this->prevImage = cl::Image2D(context, CL_MEM_READ_ONLY, fmt, width, height);
+		this->currImage = cl::Image2D(context, CL_MEM_READ_ONLY, fmt, width, height);
+
+		this->width = width;
+		this->height = height;
+		this->region[0] = width;
+		this->region[1] = height;
+		this->region[2] = 1;
+	};
+
+	//prev is only uploaded when the last call wasn't given the frame before curr
+	void Match(int method, const cv::Mat& curr, const cv::Mat& prev, bool consecutive, MotionField& field) {
+		const int bCount = field.GetCount();
+
+		//Upload frames, writes are not blocking as the blocking reads below finish the queue before the data changes. Rows
+		//are given their pitch as frames may be views, e.g. of a frame stack
+		std::swap(this->prevImage, this->currImage);
+		bool upload_prev = !consecutive || !this->uploaded;
+
+		if (upload_prev)
+			this->queue.enqueueWriteImage(this->prevImage, CL_FALSE, this->origin, this->region, prev.step, 0, prev.data, NULL, this->Event(0));
+
+		this->queue.enqueueWriteImage(this->currImage, CL_FALSE, this->origin, this->region, curr.step, 0, curr.data, NULL, this->Event(1));
+		this->uploaded = true;
+
+		//Create buffers to store motion vectors for blocks of wB * hB (bCount)
+		if (this->buffer_count != bCount) {
+			this->dxBuffer = cl::Buffer(this->context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * bCount);
+			this->dyBuffer = cl::Buffer(this->context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * bCount);
+			this->costBuffer = cl::Buffer(this->context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * bCount);
+			this->buffer_count = bCount;
+		}
+
+		//Set arguments of the selected kernel
+		cl::Kernel& kernel = this->kernels[method];
+		kernel.setArg(0, this->prevImage);
+		kernel.setArg(1, this->currImage);
+		kernel.setArg(2, field.GetStepSize());
+		kernel.setArg(3, field.GetBlockSize());
+		kernel.setArg(4, this->width);
+		kernel.setArg(5, this->height);
+		kernel.setArg(6, this->dxBuffer);
+		kernel.setArg(7, this->dyBuffer);
+		kernel.setArg(8, this->costBuffer);
+
+		//Queue kernel with global range spanning all blocks
+		cl::NDRange global((size_t)field.GetWB(), (size_t)field.GetHB(), 1);
+		this->queue.enqueueNDRangeKernel(kernel, 0, global, cl::NullRange, NULL, this->Event(2));
+
+		//Read motion vectors from device straight into the field
+		this->queue.enqueueReadBuffer(this->dxBuffer, CL_TRUE, 0, sizeof(cl_int) * bCount, field.DX(), NULL, this->Event(3));
+		this->queue.enqueueReadBuffer(this->dyBuffer, CL_TRUE, 0, sizeof(cl_int) * bCount, field.DY());
+		this->queue.enqueueReadBuffer(this->costBuffer, CL_TRUE, 0, sizeof(cl_int) * bCount, field.Cost(), NULL, this->Event(4));
+		field.Invalidate();
+
+		//The queue is in order so every event has completed once the last read returned
+		if (this->latency) {
+			(*this->latency)[StageTimers::Upload]->Record(Span(this->events[upload_prev ? 0 : 1], this->events[1]));
+			(*this->latency)[StageTimers::Kernel]->Record(Span(this->events[2], this->events[2]));
+			(*this->latency)[StageTimers::Readback]->Record(Span(this->events[3], this->events[4]));
+		}
+	};
+private:
+	cl::Context context;
+	cl::CommandQueue queue;
+	cl::Kernel kernels[2];
+	cl::Image2D prevImage, currImage;
+	cl::Buffer dxBuffer, dyBuffer, costBuffer;
+	cl::size_t<3> origin, region;
+	int width, height, buffer_count = 0;
+	bool uploaded = false;
+
+	//Upload of prev and curr, kernel, first and last read
+	StageTimers * latency;
+	cl::Event events[5];
+
+	cl::Event * Event(int i) {
+		return this->latency ? &this->events[i] : NULL;
+	};
+
+	//Device time in ns from the start of first to the end of last
+	static long long int Span(const cl::Event& first, const cl::Event& last) {
+		return (long long int)(last.getProfilingInfo<CL_PROFILING_COMMAND_END>() - first.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+	};
+};
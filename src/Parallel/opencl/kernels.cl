@@ -89,6 +89,7 @@ int3 closest_inbound_neighbour(image2d_t prev, int2 currPoint, const int sWindow
 	}
 }
 
+//Results are written as separate displacement and error arrays (see MotionField), angle and magnitude are derived on the host
 __kernel void full_exhastive_ADS(
 	__read_only image2d_t prev,
 	__read_only image2d_t curr,
@@ -96,8 +97,9 @@ __kernel void full_exhastive_ADS(
 	const uint blockSize,
 	uint width,
 	uint height,
-	__global int2 * motionVectors,
-	__global float2 * motionDetails
+	__global int * dx,
+	__global int * dy,
+	__global int * cost
 )
 {
 	//Get position within work group and reference block in current frame
@@ -119,8 +121,8 @@ __kernel void full_exhastive_ADS(
 	float distanceToBlock = FLT_MAX;
 	int bestErr = INT_MAX, err;
 
-	motionVectors[idx] = currPoint;
-	motionDetails[idx] = (float2)(0, 0);
+	//Best displacement is kept in registers and written once
+	int2 best = (int2)(0, 0);
 	bestErr = matrix_sum(prev, currPoint, blockSize, 0);
 
 	int ref_err = matrix_sum(prev, (int2)(currPoint.x, currPoint.y), blockSize, 0);
@@ -143,18 +145,18 @@ __kernel void full_exhastive_ADS(
 				//if (x == 2 && y == 2)
 					//printf("%d vs %d == %d\n", current_err, ref_err, err);
 
-				//TODO: Calculate angle if point was on radius of blocksize/2 rather than radius of point to center distance
 				if (err < bestErr || (err == bestErr && newDistance <= distanceToBlock)) {
 					bestErr = err;
 					distanceToBlock = newDistance;
-					float p0x = currPoint.x, p0y = currPoint.y - sqrt((float)(square(refPoint.x - p0x) + square(refPoint.y - currPoint.y)));
-					float angle = (2 * atan2(refPoint.y - p0y, refPoint.x - p0x)) * 180 / M_PI;
-					motionVectors[idx] = refPoint;
-					motionDetails[idx] = (float2)(angle, distanceToBlock);
+					best = (int2)(row, col);
 				}
 			}
 		}
 	}
+
+	dx[idx] = best.x;
+	dy[idx] = best.y;
+	cost[idx] = bestErr;
 }
 
 __kernel void full_exhastive_SAD(
@@ -164,8 +166,9 @@ __kernel void full_exhastive_SAD(
 	const uint blockSize,
 	uint width,
 	uint height,
-	__global int2 * motionVectors,
-	__global float2 * motionDetails
+	__global int * dx,
+	__global int * dy,
+	__global int * cost
 )
 {
 	//Get position within work group and reference block in current frame
@@ -179,6 +182,7 @@ __kernel void full_exhastive_SAD(
 	const int sWindow = blockSize;
 	float distanceToBlock = FLT_MAX;
 	float bestErr = FLT_MAX, err;
+	int2 best = (int2)(0, 0);
 
 	//Loop over all possible blocks within each macroblock
 	for (int row = -sWindow; row < sWindow; row++) {
@@ -195,14 +199,15 @@ __kernel void full_exhastive_SAD(
 				if (err < bestErr || (err == bestErr && newDistance <= distanceToBlock)) {
 					bestErr = err;
 					distanceToBlock = newDistance;
-					float p0x = currPoint.x, p0y = currPoint.y - sqrt((float)(square(refPoint.x - p0x) + square(refPoint.y - currPoint.y)));
-					float angle = (2 * atan2(refPoint.y - p0y, refPoint.x - p0x)) * 180 / M_PI;
-					motionVectors[idx] = refPoint;
-					motionDetails[idx] = (float2)(angle, distanceToBlock);
+					best = (int2)(row, col);
 				}
 			}
 		}
 	}
+
+	dx[idx] = best.x;
+	dy[idx] = best.y;
+	cost[idx] = bestErr == FLT_MAX ? INT_MAX : (int)bestErr;
 }
 
 
@@ -19,12 +19,19 @@
 //#include "Dicom.hpp"
 
 #include "CLContext.hpp"
+#include "DeviceMatcher.hpp"
 #include "Drawing.hpp"
-#include "Capture.hpp"
+#include "FrameSource.hpp"
 #include "Timer.hpp"
 #include "Utils.hpp"
 #include "SimpleGraph.hpp"
 #include "IO.hpp"
+#include "MotionField.hpp"
+#include "Options.hpp"
+#include "SPSCQueue.hpp"
+#include "FramePipeline.hpp"
+#include "HeartRate.hpp"
+#include "MotionRecording.hpp"
 
 int main(int argc, char **argv)
 {
@@ -45,6 +52,17 @@ int main(int argc, char **argv)
 	std::string dataPathVideo = root_directory + "/data/input.avi";
 	std::string results_path = root_directory + "/results/raw/parallel/" + std::to_string(std::time(nullptr)) + ".txt";
 
+	//Input, ROI, block size and engine may be given on the command line, --headless processes the file once without windows.
+	//CLContext reads the same argv for its own options.
+	Options options(argc, argv);
+	bool headless = options.headless;
+
+	if (!options.input.empty())
+		dataPathVideo = options.input;
+
+	if (!options.output.empty())
+		results_path = options.output;
+
 	//Get Context
 	CLContext clUtil(argc, argv);
 	cl::Context context = clUtil.GetContext();
@@ -68,22 +86,31 @@ int main(int argc, char **argv)
 		throw err;
 	}
 
-	//Create command queue for context (outside of the loop?)
-	cl::CommandQueue queue(context);
+	//Open the video (or frame stack, or DICOM when built with DCMTK), frames are only kept in colour when they are drawn
+	std::unique_ptr<FrameSource> source = FrameSource::Open(dataPathVideo, !headless, options.decodeThreads);
+	if (!source)
+		return 1;
 
-	//Open Video Capture to File
-	//Dicom Capture(dataPath, true);
-	Capture Capture(dataPathVideo);
-
-	//Allocate Mat for previous and current frame
-	cv::Mat prev, curr, prevGray, currGray;
-	Capture >> curr;
+	//Read the first frame for ROI selection, the pipeline crops every frame from the full first frame onwards
+	cv::Mat first, curr;
+	*source >> first;
+	curr = first;
 
 	//Select ROI
 	cv::Rect roi;
 	bool set_roi = true;
 
-	if (set_roi)
+	if (options.HasROI())
+	{
+		roi = options.roi & cv::Rect(0, 0, curr.cols, curr.rows);
+		curr = curr(roi);
+	}
+	else if (headless)
+	{
+		//Whole frame
+		set_roi = false;
+	}
+	else if (set_roi)
 	{
 		std::string winname("Press' Y' or 'y' when ROI selection has been made");
 		cv::namedWindow(winname, cv::WINDOW_AUTOSIZE);
@@ -97,15 +124,31 @@ int main(int argc, char **argv)
 	}
 
 	//Define BM parameters
-	int width = curr.size().width, height = curr.size().height, frame_count = Capture.GetFrameCount();
+	int width = curr.size().width, height = curr.size().height, frame_count = source->GetFrameCount();
+
+	//Heart rate from the average angle of each frame, the frame rate of an AVI converted from DICOM may not be the real one
+	HeartRate heart_rate(options.frameTime > 0 ? 1000.0f / options.frameTime : (float)source->GetFrameRate());
 
 	//Get all possible block sizes
 	std::vector<int> bSizes = Util::getBlockSizes(width, height);
 	int  bID = bSizes.size() >= 2 ? 1 : 0, blockSize = bSizes.at(bID);
+
+	if (options.blockSize > 0) {
+		std::vector<int>::iterator it = std::find(bSizes.begin(), bSizes.end(), options.blockSize);
+
+		if (it != bSizes.end()) {
+			bID = (int)(it - bSizes.begin());
+			blockSize = *it;
+		}
+		else {
+			std::cerr << "Ignoring --block " << options.blockSize << ", it must divide the ROI width and height" << std::endl;
+		}
+	}
+
 	int stepSize = Util::getStepSize(blockSize);
 
-	//Minus one because last block along x * stepSize + y * stepSize * wB will always be out of bounds
-	int wB = (width / blockSize * blockSize / stepSize) - 1, hB = (height / blockSize * blockSize / stepSize) - 1;
+	cv::Size grid = Util::getBlockGrid(width, height, blockSize, stepSize);
+	int wB = grid.width, hB = grid.height;
 
 	int bCount = wB * hB;
 
@@ -114,21 +157,32 @@ int main(int argc, char **argv)
 
 	//Create output Window and use Parallel as unique winname
 	std::string winname("Parallel");
-	cv::namedWindow(winname, cv::WINDOW_AUTOSIZE);
+
+	if (!headless)
+		cv::namedWindow(winname, cv::WINDOW_AUTOSIZE);
 
 	//Should the image file loop?
-	bool loop = true;
+	bool loop = !headless;
 
 	//Create Timer to time each frame loop and variables for framerate
 	//Log Processed Frames per second and rendered
 	Timer pT(50), rT(50);
 
+	//Latency of every stage with --latency, reported every 10s and at exit
+	StageTimers stage_timers;
+	StageTimers * latency = options.latency ? &stage_timers : NULL;
+	Timer report, draw;
+
 	//Create Real-Time graph to display average angular motion
 	SimpleGraph motion_graph(1024, 512, 128);
 
-	//Create File Writer
-	IO::Writer output_data(results_path);
-	output_data.AddLine("Angle 0-360", "Magnitude");
+	//Results are streamed to disk as frames are analysed
+	IO::RecordWriter output_data(results_path, options.tsv);
+
+	//Every motion field as well when asked to, for --replay
+	std::unique_ptr<MotionRecorder> recorder;
+	if (!options.record.empty())
+		recorder.reset(new MotionRecorder(options.record, width, height, options.frameTime > 0 ? options.frameTime : source->GetFrameRate() > 0 ? 1000.0 / source->GetFrameRate() : 0));
 
 	//Timeout to wait for key press (< 1 Waits indef)
 	int cvWaitTime = 1;
@@ -136,110 +190,188 @@ int main(int argc, char **argv)
 	int method = 0;
 	bool draw_motion_vectors = false, draw_hsv = false;
 
-	try {
-		do {
-			//Start timer
-			pT.tic();
-			rT.tic();
-
-			prev = curr.clone(); //TODO: Test skipping frames
-			Capture >> curr;
+	//Engine names accepted by --engine, the index of the kernel
+	if (options.engine == "sad")
+		method = 0;
+	else if (options.engine == "ads")
+		method = 1;
+	else if (!options.engine.empty())
+		std::cerr << "Unknown engine " << options.engine << ", expected sad or ads" << std::endl;
+
+	//Frame pairs matched at once by offline runs, each on its own command queue
+	int pairs = 1;
+
+	if (options.pairs != 1 && !headless)
+		std::cerr << "Ignoring --pairs, frame pairs are only matched concurrently with --headless" << std::endl;
+	else if (options.pairs != 1)
+		pairs = options.pairs > 0 ? options.pairs : std::max(1u, std::thread::hardware_concurrency());
+
+	//Keys that change matching are forwarded to the first match stage, which owns the block configuration
+	SPSCQueue<char> controls(16);
+
+	auto apply_control = [&](char control) {
+		switch (control) {
+		case '+':
+			bID = bID < bSizes.size() - 1 ? bID + 1 : bID;
+			blockSize = bSizes.at(bID);
+			stepSize = Util::getStepSize(blockSize);
+			grid = Util::getBlockGrid(width, height, blockSize, stepSize);
+			wB = grid.width;
+			hB = grid.height;
+			bCount = wB * hB;
+			break;
+		case '-':
+			bID = bID > 0 ? bID - 1 : 0;
+			blockSize = bSizes.at(bID);
+			stepSize = Util::getStepSize(blockSize);
+			grid = Util::getBlockGrid(width, height, blockSize, stepSize);
+			wB = grid.width;
+			hB = grid.height;
+			bCount = wB * hB;
+			break;
+		case 'm':
+			method = method == 0 ? 1 : 0;
+			break;
+		default:
+			break;
+		}
+	};
+
+	//Decode, convert, match and analyse run on their own threads, this thread renders
+	//Frames of the first pass are kept for the passes after it while they fit in --cache
+	FramePipeline pipeline(*source, first, roi, set_roi, loop, !headless, (size_t)std::max(0, options.cacheMB) << 20);
+	pipeline.SetLatency(latency);
 
-			//Break if invalid frames and no loop
-			if (prev.empty() || curr.empty()) {
-				//Reset pointer to frame if loop
-				if (loop) {
-					output_data.Write();
+	try {
+		//Device memory and a command queue for each match stage, created up front so errors are caught below
+		std::vector<std::shared_ptr<DeviceMatcher>> matchers;
+		for (int i = 0; i < pairs; i++)
+			matchers.push_back(std::make_shared<DeviceMatcher>(context, program, width, height, latency));
+
+		//Match stage i, only the first takes keys as the others only run headless
+		auto match_stage = [&](int i) {
+			std::shared_ptr<DeviceMatcher> matcher = matchers[i];
+			int last = -1;
+
+			return FramePipeline::Stage([&, i, matcher, last, pT](FramePacket& packet) mutable {
+				char control;
+				while (i == 0 && controls.TryPop(control))
+					apply_control(control);
+
+				//First frame of the input, or of another pass over it, is only the reference frame of the next
+				if (packet.first)
+					return;
+
+				pT.tic();
+
+				MotionField& motion_field = packet.field;
+				if (motion_field.GetWB() != wB || motion_field.GetHB() != hB || motion_field.GetBlockSize() != blockSize)
+					motion_field.Resize(wB, hB, blockSize, stepSize);
+
+				matcher->Match(method, packet.gray, packet.prevGray, packet.index == last + 1, motion_field);
+				last = packet.index;
+
+				//Clock timer so FPS isn't inclusive of drawing onto the screen
+				pT.toc();
+				packet.processed_fps = pT.getFPSFromElapsed();
+			});
+		};
+
+		std::vector<FramePipeline::Stage> match_stages;
+		for (int i = 0; i < pairs; i++)
+			match_stages.push_back(match_stage(i));
+
+		//Concurrent pairs are dealt in runs of consecutive frames so each queue still uploads one frame per pair
+		pipeline.Start(match_stages,
+		//Analyse stage
+		[&](FramePacket& packet) {
+			if (packet.first) {
+				//Each pass over a looping input gets its own results file
+				if (packet.sequence > 0) {
 					output_data.NewFile(root_directory + "/results/raw/parallel/" + std::to_string(std::time(nullptr)) + ".txt");
-					Capture.SetPos(0);
-					Capture >> curr;
-					motion_graph.Reset();
-					continue;
+					heart_rate.Reset();
 				}
 
-				break;
+				return;
 			}
 
-			if (set_roi)
-				curr = curr(roi);
-
-			//Convert frames to grayscale for faster processing. Keep original data for visualisation
-			cv::cvtColor(prev, prevGray, cv::COLOR_BGR2GRAY);
-			cv::cvtColor(curr, currGray, cv::COLOR_BGR2GRAY);
+			packet.averages = Util::analyseData(packet.field);
+			output_data.Add(packet.index, packet.averages[0], packet.averages[1], packet.averages[2], packet.averages[3]);
 
-			//Convert data (int) to char array
-			char *prevBuffer = reinterpret_cast<char *>(prevGray.data);
-			char *currBuffer = reinterpret_cast<char *>(currGray.data);
+			if (recorder)
+				recorder->Add(packet.index, packet.field);
 
-			//Create image2d_t from buffer (CL_INTENSITY = uint4(I,I,I,I))
-			//CL_UNSIGNED_INT8 for write_imageui
-			cl::ImageFormat fmt(CL_INTENSITY, CL_UNSIGNED_INT8);
-			cl::Image2D prevImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, fmt, width, height, 0, prevBuffer);
-			cl::Image2D currImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, fmt, width, height, 0, currBuffer);
+			heart_rate.Add(packet.averages[3]);
+			packet.bpm = heart_rate.GetBPM();
+		}, pairs > 1 ? 8 : 1);
 
-			//Create buffer to store motion vectors for blocks of wB * hB (bCount)
-			cl::Buffer motionVectors(context, CL_MEM_WRITE_ONLY, sizeof(cl_int2) * bCount);
-			cl::Buffer motionDetails(context, CL_MEM_WRITE_ONLY, sizeof(cl_float2) * bCount);
+		//Whole run timer for the total frame rate reported in headless mode
+		Timer total;
+		long long processed_frames = 0;
+		float bpm = 0;
+		total.tic();
 
-			//Create motion_estimation kernel and set arguments 
-			cl::Kernel kernel(program, method == 0 ? "full_exhastive_SAD" : "full_exhastive_ADS");
-			kernel.setArg(0, prevImage);
-			kernel.setArg(1, currImage);
-			kernel.setArg(2, stepSize);
-			kernel.setArg(3, blockSize);
-			kernel.setArg(4, width);
-			kernel.setArg(5, height);
-			kernel.setArg(6, motionVectors);
-			kernel.setArg(7, motionDetails);
+		//Render stage, rT measures the rate frames leave the pipeline
+		FramePacket * packet;
+		rT.tic();
+		report.tic();
 
-			//Queue kernel with global range spanning all blocks
-			cl::NDRange global((size_t)wB, (size_t)hB, 1);
-			queue.enqueueNDRangeKernel(kernel, 0, global, cl::NullRange);
+		while (key != 27 && pipeline.Pop(packet)) { //While !Esc and frames remain
+			if (packet->first) {
+				motion_graph.Reset();
+				pipeline.Release(packet);
+				continue;
+			}
 
-			//queue.finish();
+			processed_frames++;
+			bpm = packet->bpm;
 
-			//TODO: declare outside loop
-			//Read motion vector buffer from device
-			cl_int2 * mVecBuffer = new cl_int2[bCount];
-			cl_float2 * mDetailsBuffer = new cl_float2[bCount];
+			//Before the headless branch so headless runs report too
+			if (latency && report.getElapsed() > 10 * NANO) {
+				latency->Report(std::cout);
+				report.tic();
+			}
 
-			queue.enqueueReadBuffer(motionVectors, 0, 0, sizeof(cl_int2) * bCount, mVecBuffer);
-			queue.enqueueReadBuffer(motionDetails, 0, 0, sizeof(cl_float2) * bCount, mDetailsBuffer);
+			//Nothing to render
+			if (headless) {
+				pipeline.Release(packet);
+				continue;
+			}
 
-			//Clock timer so FPS isn't inclusive of drawing onto the screen
-			pT.toc();
+			//Draw latency is up to the frame being shown, not the wait for a key
+			draw.tic();
 
 			//Create seperate file for drawing to the screen
-			cv::Mat display = curr.clone();
+			cv::Mat display = packet->colour.clone();
 
 			//Draw Motion Vectors from mVecBuffer
-			cv::Vec4f averages = Util::analyseData(mVecBuffer, mDetailsBuffer, wB * hB);
-			motion_graph.AddData(averages[3]);
+			motion_graph.AddData(packet->averages[3]);
 
 			//Draw::Arrow(display, cv::Point(averages[0], averages[1]));
 
 			if(draw_motion_vectors)
-				Draw::MotionVectors(display, mVecBuffer, wB, hB, blockSize, stepSize);
+				Draw::MotionVectors(display, packet->field);
 
 			if(draw_hsv)
-				Draw::MotionVectorHSVAngles(display, mVecBuffer, mDetailsBuffer, wB, hB, blockSize, stepSize, 127, 0.2);
-
-			output_data.AddLine(std::to_string(averages[3]), std::to_string(averages[2]));
+				Draw::MotionVectorHSVAngles(display, packet->field, 127, 0.2);
 
-			//Free pointer block
-			free(mVecBuffer);
-			free(mDetailsBuffer);
-
-			//Finish render timer
 			rT.toc();
+			rT.tic();
 
 			//Display program information on frame
-			//Draw::Text(display, std::to_string(Capture.GetPos()), std::to_string(blockSize), std::to_string(stepSize), std::to_string(pT.getFPSFromElapsed()), std::to_string(rT.getFPSFromElapsed()));
-			motion_graph.DrawInfoText(std::to_string(Capture.GetPos()), std::to_string(blockSize), std::to_string(stepSize), std::to_string(pT.getFPSFromElapsed()), std::to_string(rT.getFPSFromElapsed()));
+			//Draw::Text(display, std::to_string(source->GetPos()), std::to_string(blockSize), std::to_string(stepSize), std::to_string(pT.getFPSFromElapsed()), std::to_string(rT.getFPSFromElapsed()));
+			motion_graph.DrawInfoText(std::to_string(packet->index), std::to_string(packet->field.GetBlockSize()), std::to_string(packet->field.GetStepSize()), std::to_string(packet->processed_fps), std::to_string(rT.getFPSFromElapsed()));
+			Draw::BPM(display, packet->bpm);
+
+			pipeline.Release(packet);
+
 			//Display visualisation of motion vectors
 			cv::imshow(winname, display);
 			motion_graph.Show();
 
+			if (latency)
+				(*latency)[StageTimers::Draw]->Record(draw.getElapsed());
+
 			key = (char)cv::waitKey(cvWaitTime);
 
 			switch (key) {
@@ -247,23 +379,11 @@ int main(int argc, char **argv)
 				cvWaitTime = cvWaitTime == 0 ? 1 : 0;
 				break;
 			case '+':
-				bID = bID < bSizes.size() - 1 ? bID + 1 : bID;
-				blockSize = bSizes.at(bID);
-				stepSize = Util::getStepSize(blockSize);
-				wB = (width / blockSize * blockSize / stepSize) - 1;
-				hB = (height / blockSize * blockSize / stepSize) - 1;
-				bCount = wB * hB;
-				break;
 			case '-':
-				bID = bID > 0 ? bID - 1 : 0;
-				blockSize = bSizes.at(bID);
-				stepSize = Util::getStepSize(blockSize);
-				wB = (width / blockSize * blockSize / stepSize) - 1;
-				hB = (height / blockSize * blockSize / stepSize) - 1;
-				bCount = wB * hB;
+				controls.TryPush(key);
 				break;
 			case 'm':
-				method = method == 0 ? 1 : 0;
+				controls.TryPush(key);
 				motion_graph.Reset();
 				break;
 			case 'd':
@@ -275,7 +395,20 @@ int main(int argc, char **argv)
 			default:
 				break;
 			}
-		} while (key != 27); //Do while !Esc
+		}
+
+		//Stage threads are joined before their state (e.g. output_data) is used here
+		pipeline.Stop();
+
+		if (latency)
+			latency->Report(std::cout);
+
+		if (headless) {
+			float seconds = total.getElapsed() / NANO;
+			output_data.Close();
+			std::cout << "Processed " << processed_frames << " frames in " << seconds << "s, " << (seconds > 0 ? processed_frames / seconds : 0) << " frames/s, " << bpm << " BPM" << std::endl;
+			return 0;
+		}
 	}
 	catch (cl::Error err) {
 		std::cerr << "ERROR: " << err.what() << ", " << clUtil.GetErrorString(err.err()) << std::endl;
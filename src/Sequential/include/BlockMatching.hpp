@@ -1,5 +1,10 @@
+#pragma once
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <utility>
+#include <climits>
+#include <type_traits>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -7,6 +12,10 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui.hpp>
 
+#include "SADKernel.hpp"
+#include "ThreadPool.hpp"
+#include "MotionField.hpp"
+
 namespace BlockMatching {
 	inline float square(float x) {
 		return x * x;
@@ -24,11 +33,9 @@ namespace BlockMatching {
 		return cv::sum(cv::abs(img(cv::Rect(p.x, p.y, blockSize, blockSize))))[0];
 	}
 
+	//Expects 8-bit single channel frames, works on the rows in place rather than through ROI and difference Mats
 	inline int MatrixSAD(const cv::Mat& curr, const cv::Mat& ref, const cv::Point& currPoint, const cv::Point& refPoint, const int& blockSize) {
-		return cv::sum(cv::abs(
-			curr(cv::Rect(currPoint.x, currPoint.y, blockSize, blockSize)) -
-			ref(cv::Rect(refPoint.x, refPoint.y, blockSize, blockSize))
-		))[0];
+		return BlockSAD(curr.ptr(currPoint.y) + currPoint.x, curr.step, ref.ptr(refPoint.y) + refPoint.x, ref.step, blockSize, blockSize);
 	}
 
 	inline bool IsInBounds(int x, int y, int width, int height, int bSize) {
@@ -50,143 +57,372 @@ namespace BlockMatching {
 		return cv::Vec3i(0, 0, MatrixSum(prev, refPoint, blockSize));
 	}
 
-	void FullExhastiveADS(cv::Mat& curr, cv::Mat& ref, cv::Point* &motionVectors, cv::Point2f* &motionDetails, int blockSize, int stepSize, int width, int height, int wB, int hB) {
-		//Loop over all possible blocks in frame
-		for (int x = 0; x < wB; x++) {
-			for (int y = 0; y < hB; y++) {
-				//Reference point on current frame that will be searched for in the previous frame
-				const cv::Point currPoint(x * stepSize, y * stepSize);
-				int idx = x + y * wB;
-
-				int current_err = MatrixSum(curr, currPoint, blockSize);
-
-				const int sWindow = blockSize;
-				cv::Vec3i closest = ClosestNeighbour(ref, currPoint, sWindow, width, height, blockSize);
-				//int ref_err = closest[2];
-
-				float distanceToBlock = FLT_MAX;
-				int bestErr = INT_MAX, err;
-
-				//Loop over all possible blocks within each macroblock
-				for (int row = closest[0]; row < sWindow; row++) {
-					for (int col = closest[1]; col < sWindow; col++) {
-						//Refererence a block to search on the previous frame
-						cv::Point refPoint(currPoint.x + row, currPoint.y + col);
-
-						//Check if it lays within the bounds of the capture
-						if (IsInBounds(refPoint.x, refPoint.y, width, height, blockSize)) {
-							//Calculate SSD (Sum of square differences)
-
-							int ref_err = MatrixSum(ref, refPoint, blockSize);
-							err = AbsoluteDifference(current_err, ref_err);
-
-							//Take the lowest error, closeness is preffered.
-							float newDistance = euclideanDistance(refPoint.x, currPoint.x, refPoint.y, currPoint.y);
-
-							//Write buffer with the lowest error
-							if (err < bestErr || (err == bestErr && newDistance <= distanceToBlock)) {
-								bestErr = err;
-								distanceToBlock = newDistance;
-								float p0x = currPoint.x, p0y = currPoint.y - sqrt((float)(square(refPoint.x - p0x) + square(refPoint.y - currPoint.y)));
-								float angle = (2 * atan2(refPoint.y - p0y, refPoint.x - p0x)) * 180 / M_PI;
-								motionVectors[idx] = refPoint;
-								motionDetails[idx] = cv::Point2f(angle, distanceToBlock);
-							}
-						}
-					}
+	//Offset the exhaustive loops start from, the first in bounds corner of the window (ClosestNeighbour without the block sum)
+	inline cv::Point ClosestInBoundsOffset(const cv::Point& currPoint, const int sWindow, const int width, const int height, const int blockSize) {
+		for (int row = -sWindow; row < sWindow; row += sWindow) {
+			for (int col = -sWindow; col < sWindow; col += sWindow) {
+				if (IsInBounds(currPoint.x + row, currPoint.y + col, width, height, blockSize)) {
+					return cv::Point(row, col);
 				}
 			}
 		}
+
+		return cv::Point(0, 0);
 	}
 
-	void FullExhastiveSAD(cv::Mat& curr, cv::Mat& ref, cv::Point* &motionVectors, cv::Point2f* &motionDetails, int blockSize, int stepSize, int width, int height, int wB, int hB) {
-		//Loop over all possible blocks in frame
-		for (int x = 0; x < wB; x++) {
-			for (int y = 0; y < hB; y++) {
-				//Reference point on current frame that will be searched for in the previous frame
-				const cv::Point currPoint(x * stepSize, y * stepSize);
-				int idx = x + y * wB;
-
-				const int sWindow = blockSize;
-				cv::Vec3i closest = ClosestNeighbour(ref, currPoint, sWindow, width, height, blockSize);
-				//int ref_err = closest[2];
-
-				float distanceToBlock = FLT_MAX;
-				int bestErr = INT_MAX, err;
-
-				//Loop over all possible blocks within each macroblock
-				for (int row = closest[0]; row < sWindow; row++) {
-					for (int col = closest[1]; col < sWindow; col++) {
-						//Refererence a block to search on the previous frame
-						cv::Point refPoint(currPoint.x + row, currPoint.y + col);
-
-						//Check if it lays within the bounds of the capture
-						if (IsInBounds(refPoint.x, refPoint.y, width, height, blockSize)) {
-							//Calculate SSD (Sum of square differences)
-
-							err = MatrixSAD(curr, ref, currPoint, refPoint, blockSize);
-
-							//Take the lowest error, closeness is preffered.
-							float newDistance = euclideanDistance(refPoint.x, currPoint.x, refPoint.y, currPoint.y);
-
-							//Write buffer with the lowest error
-							if (err < bestErr || (err == bestErr && newDistance <= distanceToBlock)) {
-								bestErr = err;
-								distanceToBlock = newDistance;
-								float p0x = currPoint.x, p0y = currPoint.y - sqrt((float)(square(refPoint.x - p0x) + square(refPoint.y - currPoint.y)));
-								float angle = (2 * atan2(refPoint.y - p0y, refPoint.x - p0x)) * 180 / M_PI;
-								motionVectors[idx] = refPoint;
-								motionDetails[idx] = cv::Point2f(angle, distanceToBlock);
-							}
-						}
-					}
+	//Blocks per tile side, small enough that border tiles (fewer in bound candidates) can be stolen to balance threads
+	const int DefaultTileSize = 4;
+
+	//Run block(x, y) for every block in the wB x hB grid. Without a pool the grid is walked column by column as the
+	//original loops did, with a pool it is split into square tiles. Every block writes only its own idx so the motion
+	//field is identical whatever order tiles complete in.
+	template<typename BlockFunction>
+	void ForEachBlock(ThreadPool * pool, int wB, int hB, BlockFunction block, int tileSize = DefaultTileSize) {
+		if (pool == nullptr) {
+			for (int x = 0; x < wB; x++) {
+				for (int y = 0; y < hB; y++) {
+					block(x, y);
 				}
 			}
+			return;
 		}
+
+		const int tilesX = (wB + tileSize - 1) / tileSize, tilesY = (hB + tileSize - 1) / tileSize;
+
+		pool->ParallelFor(tilesX * tilesY, [&](int tile) {
+			const int x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize;
+			const int x1 = std::min(x0 + tileSize, wB), y1 = std::min(y0 + tileSize, hB);
+
+			for (int x = x0; x < x1; x++) {
+				for (int y = y0; y < y1; y++) {
+					block(x, y);
+				}
+			}
+		});
 	}
 
-	void NaiveFullExhastive(cv::Mat& curr, cv::Mat& ref, cv::Point* &motionVectors, int blockSize, int width, int height, int wB, int hB) {
-		//Loop over all possible blocks in frame
-		for (int x = 0; x < wB; x++) {
-			for (int y = 0; y < hB; y++) {
-				//Reference point on current frame that will be searched for in the previous frame
-				const cv::Point currPoint(x * blockSize, y * blockSize);
-				int idx = x + y * wB;
-
-				cv::Rect middle(currPoint.x, currPoint.y, blockSize, blockSize);
-				const int sWindow = blockSize;
-				float distanceToBlock = FLT_MAX;
-				float bestErr = FLT_MAX, err;
-
-				//Loop over all possible blocks within each macroblock
-				for (int row = -sWindow; row < sWindow; row++) {
-					for (int col = -sWindow; col < sWindow; col++) {
-						//Refererence a block to search on the previous frame
-						cv::Point refPoint(currPoint.x + row, currPoint.y + col);
-
-						//Check if it lays within the bounds of the capture
-						if (refPoint.y >= 0 && refPoint.y < height - blockSize && refPoint.x >= 0 && refPoint.x < width - blockSize) {
-							//Calculate SSD (Sum of square differences)
-							cv::Mat diff = cv::abs(curr(middle) - ref(cv::Rect(refPoint.x, refPoint.y, blockSize, blockSize)));
-							err = cv::sum(diff)[0];
-
-							//Take the lowest error, closeness is preffered.
-							float newDistance = euclideanDistance(refPoint.x, currPoint.x, refPoint.y, currPoint.y);
-
-							//Write buffer with the lowest error
-							if (err < bestErr) {
-								bestErr = err;
-								distanceToBlock = newDistance;
-								motionVectors[idx] = refPoint;
-							}
-							else if (err == bestErr && newDistance <= distanceToBlock) {
-								distanceToBlock = newDistance;
-								motionVectors[idx] = refPoint;
-							}
-						}
+	//Block side is N when it is known at compile time so the cost loops have constant trip counts, 0 means use the runtime size.
+	//Policies call Get again on their stored size so the constant survives when the search loop isn't inlined with the constructor.
+	template<int N>
+	struct BlockDim {
+		static inline int Get(int) { return N; }
+	};
+
+	template<>
+	struct BlockDim<0> {
+		static inline int Get(int blockSize) { return blockSize; }
+	};
+
+	//Cost policies are built once per current block and called once per candidate reference block. Policies whose error
+	//only grows as rows are added set PartialDistortion and also take a limit, above which they may stop early and return
+	//any value greater than the limit.
+
+	//Sum of absolute differences
+	template<int N>
+	class SADCost {
+	public:
+		static const bool PartialDistortion = true;
+
+		SADCost(const cv::Mat& curr, const cv::Mat& ref, const cv::Point& currPoint, int blockSize)
+			: ref(ref), block(curr.ptr(currPoint.y) + currPoint.x), step(curr.step), size(BlockDim<N>::Get(blockSize)) {}
+
+		inline long long operator()(const cv::Point& refPoint) const {
+			const int size = BlockDim<N>::Get(this->size);
+			return BlockSAD(this->block, this->step, this->ref.ptr(refPoint.y) + refPoint.x, this->ref.step, size, size);
+		}
+
+		inline long long operator()(const cv::Point& refPoint, long long limit) const {
+			const int size = BlockDim<N>::Get(this->size);
+			return BlockSADBounded(this->block, this->step, this->ref.ptr(refPoint.y) + refPoint.x, this->ref.step, size, size, (int)std::min<long long>(limit, INT_MAX));
+		}
+	private:
+		const cv::Mat& ref;
+		const uchar * block;
+		size_t step;
+		int size;
+	};
+
+	//Absolute difference of block sums, a lower bound of SAD
+	template<int N>
+	class ADSCost {
+	public:
+		static const bool PartialDistortion = false;
+
+		ADSCost(const cv::Mat& curr, const cv::Mat& ref, const cv::Point& currPoint, int blockSize)
+			: ref(ref), size(BlockDim<N>::Get(blockSize)) {
+			this->current = Sum(curr, currPoint);
+		}
+
+		inline long long operator()(const cv::Point& refPoint) const {
+			return AbsoluteDifference(this->current, Sum(this->ref, refPoint));
+		}
+	private:
+		const cv::Mat& ref;
+		int size, current;
+
+		inline int Sum(const cv::Mat& img, const cv::Point& p) const {
+			const int size = BlockDim<N>::Get(this->size);
+			int sum = 0;
+
+			for (int r = 0; r < size; r++) {
+				const uchar * row = img.ptr(p.y + r) + p.x;
+				for (int c = 0; c < size; c++)
+					sum += row[c];
+			}
+
+			return sum;
+		}
+	};
+
+	//Sum of square differences
+	template<int N>
+	class SSDCost {
+	public:
+		static const bool PartialDistortion = true;
+
+		SSDCost(const cv::Mat& curr, const cv::Mat& ref, const cv::Point& currPoint, int blockSize)
+			: ref(ref), block(curr.ptr(currPoint.y) + currPoint.x), step(curr.step), size(BlockDim<N>::Get(blockSize)) {}
+
+		inline long long operator()(const cv::Point& refPoint, long long limit = LLONG_MAX) const {
+			const uchar * a = this->block;
+			const uchar * b = this->ref.ptr(refPoint.y) + refPoint.x;
+			const int size = BlockDim<N>::Get(this->size);
+			long long sum = 0;
+
+			for (int r = 0; r < size; r++, a += this->step, b += this->ref.step) {
+				//A row of at most 2^15 pixels cannot overflow the int accumulator
+				int rowSum = 0;
+				for (int c = 0; c < size; c++) {
+					int d = a[c] - b[c];
+					rowSum += d * d;
+				}
+				sum += rowSum;
+
+				if (sum > limit)
+					break;
+			}
+
+			return sum;
+		}
+	private:
+		const cv::Mat& ref;
+		const uchar * block;
+		size_t step;
+		int size;
+	};
+
+	//Write the winner of a search, a block with no candidate in bounds is left stationary
+	inline void StoreBest(MotionField& field, int idx, const cv::Point& best, long long bestErr) {
+		if (bestErr == LLONG_MAX)
+			field.Set(idx, 0, 0, INT_MAX);
+		else
+			field.Set(idx, best.x, best.y, (int)std::min<long long>(bestErr, INT_MAX));
+	}
+
+	//Exhaustive search of one block shared by every cost function. fromClosest starts the window at ClosestInBoundsOffset
+	//as FullExhastiveSAD/ADS always have, otherwise at -sWindow as NaiveFullExhastive does.
+	template<template<int> class Cost, int N>
+	inline void ExhaustiveSearchBlock(const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int x, int y, int width, int height, bool fromClosest) {
+		//Reference point on current frame that will be searched for in the previous frame
+		const cv::Point currPoint(x * field.GetStepSize(), y * field.GetStepSize());
+
+		const int size = BlockDim<N>::Get(field.GetBlockSize());
+		const int sWindow = size;
+		const cv::Point start = fromClosest ? ClosestInBoundsOffset(currPoint, sWindow, width, height, size) : cv::Point(-sWindow, -sWindow);
+		const Cost<N> cost(curr, ref, currPoint, size);
+
+		float distanceToBlock = FLT_MAX;
+		long long bestErr = LLONG_MAX, err;
+		cv::Point best;
+
+		//Loop over all possible blocks within each macroblock
+		for (int row = start.x; row < sWindow; row++) {
+			for (int col = start.y; col < sWindow; col++) {
+				//Refererence a block to search on the previous frame
+				cv::Point refPoint(currPoint.x + row, currPoint.y + col);
+
+				//Check if it lays within the bounds of the capture
+				if (IsInBounds(refPoint.x, refPoint.y, width, height, size)) {
+					err = cost(refPoint);
+
+					//Take the lowest error, closeness is preffered.
+					float newDistance = euclideanDistance(refPoint.x, currPoint.x, refPoint.y, currPoint.y);
+
+					//Keep the lowest error
+					if (err < bestErr || (err == bestErr && newDistance <= distanceToBlock)) {
+						bestErr = err;
+						distanceToBlock = newDistance;
+						best = cv::Point(row, col);
 					}
 				}
 			}
 		}
+
+		StoreBest(field, x + y * field.GetWB(), best, bestErr);
+	}
+
+	//Offsets of a [-sWindow, sWindow)^2 window ordered outwards from zero displacement, offsets at equal distance keep raster order
+	inline std::vector<cv::Point> SpiralOrder(int sWindow) {
+		std::vector<cv::Point> order;
+		order.reserve(4 * sWindow * sWindow);
+
+		for (int row = -sWindow; row < sWindow; row++) {
+			for (int col = -sWindow; col < sWindow; col++) {
+				order.push_back(cv::Point(row, col));
+			}
+		}
+
+		std::stable_sort(order.begin(), order.end(), [](const cv::Point& a, const cv::Point& b) {
+			return a.x * a.x + a.y * a.y < b.x * b.x + b.y * b.y;
+		});
+
+		return order;
+	}
+
+	//ExhaustiveSearchBlock with partial distortion elimination. Candidates are visited in spiral order so a low bestErr is found
+	//early, then every other candidate stops accumulating as soon as it exceeds it. The candidate set and the tie breaking of the
+	//raster loops are kept (lowest error, then closest, then last in raster order) so the motion field is identical.
+	//cost is any object callable as cost(refPoint, limit) following the PartialDistortion contract.
+	template<typename Cost>
+	inline void SpiralSearch(const Cost& cost, MotionField& field, int idx, const cv::Point& currPoint, int blockSize, int width, int height, bool fromClosest, const std::vector<cv::Point>& order) {
+		const int sWindow = blockSize;
+		const cv::Point start = fromClosest ? ClosestInBoundsOffset(currPoint, sWindow, width, height, blockSize) : cv::Point(-sWindow, -sWindow);
+
+		float distanceToBlock = FLT_MAX;
+		long long bestErr = LLONG_MAX, err;
+		cv::Point best;
+
+		for (size_t i = 0; i < order.size(); i++) {
+			const cv::Point& d = order[i];
+
+			//Offsets the raster loops skip when starting from the closest in bounds corner
+			if (d.x < start.x || d.y < start.y)
+				continue;
+
+			cv::Point refPoint(currPoint.x + d.x, currPoint.y + d.y);
+
+			if (!IsInBounds(refPoint.x, refPoint.y, width, height, blockSize))
+				continue;
+
+			err = cost(refPoint, bestErr);
+
+			if (err > bestErr)
+				continue;
+
+			float newDistance = euclideanDistance(refPoint.x, currPoint.x, refPoint.y, currPoint.y);
+
+			if (err < bestErr || newDistance < distanceToBlock || (newDistance == distanceToBlock && (d.x > best.x || (d.x == best.x && d.y > best.y)))) {
+				bestErr = err;
+				distanceToBlock = newDistance;
+				best = d;
+			}
+		}
+
+		StoreBest(field, idx, best, bestErr);
+	}
+
+	template<template<int> class Cost, int N>
+	inline void SpiralSearchBlock(const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int x, int y, int width, int height, bool fromClosest, const std::vector<cv::Point>& order) {
+		const cv::Point currPoint(x * field.GetStepSize(), y * field.GetStepSize());
+		const int size = BlockDim<N>::Get(field.GetBlockSize());
+
+		SpiralSearch(Cost<N>(curr, ref, currPoint, size), field, x + y * field.GetWB(), currPoint, size, width, height, fromClosest, order);
+	}
+
+	template<template<int> class Cost, int N>
+	void ExhaustiveSearchBlocks(std::false_type, ThreadPool * pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height, bool fromClosest) {
+		ForEachBlock(pool, field.GetWB(), field.GetHB(), [&](int x, int y) {
+			ExhaustiveSearchBlock<Cost, N>(curr, ref, field, x, y, width, height, fromClosest);
+		});
+	}
+
+	template<template<int> class Cost, int N>
+	void ExhaustiveSearchBlocks(std::true_type, ThreadPool * pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height, bool fromClosest) {
+		//The window is the same for every block so the order is built once per frame
+		const std::vector<cv::Point> order = SpiralOrder(BlockDim<N>::Get(field.GetBlockSize()));
+
+		ForEachBlock(pool, field.GetWB(), field.GetHB(), [&](int x, int y) {
+			SpiralSearchBlock<Cost, N>(curr, ref, field, x, y, width, height, fromClosest, order);
+		});
+	}
+
+	//Costs that support early termination use the spiral search, the others the raster loops
+	template<template<int> class Cost, int N>
+	void ExhaustiveSearch(ThreadPool * pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height, bool fromClosest) {
+		field.Invalidate();
+		ExhaustiveSearchBlocks<Cost, N>(std::integral_constant<bool, Cost<N>::PartialDistortion>(), pool, curr, ref, field, width, height, fromClosest);
+	}
+
+	typedef void(*ExhaustiveSearchFunction)(ThreadPool *, const cv::Mat&, const cv::Mat&, MotionField&, int, int, bool);
+
+	//Fully unrolled variants for the sizes Util::getBlockSizes commonly returns for ROIs rounded to 10 pixels, anything else
+	//uses the runtime sized instantiation
+	template<template<int> class Cost>
+	ExhaustiveSearchFunction GetExhaustiveSearch(int blockSize) {
+		static const std::pair<int, ExhaustiveSearchFunction> table[] = {
+			{ 2, &ExhaustiveSearch<Cost, 2> },
+			{ 4, &ExhaustiveSearch<Cost, 4> },
+			{ 5, &ExhaustiveSearch<Cost, 5> },
+			{ 8, &ExhaustiveSearch<Cost, 8> },
+			{ 10, &ExhaustiveSearch<Cost, 10> },
+			{ 16, &ExhaustiveSearch<Cost, 16> },
+			{ 20, &ExhaustiveSearch<Cost, 20> },
+			{ 25, &ExhaustiveSearch<Cost, 25> },
+			{ 32, &ExhaustiveSearch<Cost, 32> },
+			{ 40, &ExhaustiveSearch<Cost, 40> }
+		};
+
+		for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+			if (table[i].first == blockSize)
+				return table[i].second;
+		}
+
+		return &ExhaustiveSearch<Cost, 0>;
+	}
+
+	enum class CostFunction { SAD, ADS, SSD };
+
+	//Match every block of field, whose grid sets the block and step size
+	void ExhaustiveSearch(CostFunction method, ThreadPool * pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height, bool fromClosest = true) {
+		ExhaustiveSearchFunction search;
+
+		switch (method) {
+		case CostFunction::ADS:
+			search = GetExhaustiveSearch<ADSCost>(field.GetBlockSize());
+			break;
+		case CostFunction::SSD:
+			search = GetExhaustiveSearch<SSDCost>(field.GetBlockSize());
+			break;
+		default:
+			search = GetExhaustiveSearch<SADCost>(field.GetBlockSize());
+			break;
+		}
+
+		search(pool, curr, ref, field, width, height, fromClosest);
+	}
+
+	//The original interface filling interleaved arrays of reference points and (angle, magnitude), kept for callers that
+	//still use them. Each call allocates a temporary field, loops should hold a MotionField and use ExhaustiveSearch.
+	void ExhaustiveSearch(CostFunction method, cv::Mat& curr, cv::Mat& ref, cv::Point* motionVectors, cv::Point2f* motionDetails, int blockSize, int stepSize, int width, int height, int wB, int hB, bool fromClosest = true) {
+		MotionField field(wB, hB, blockSize, stepSize);
+		ExhaustiveSearch(method, nullptr, curr, ref, field, width, height, fromClosest);
+		field.CopyTo(motionVectors, motionDetails);
+	}
+
+	void FullExhastiveADS(cv::Mat& curr, cv::Mat& ref, cv::Point* &motionVectors, cv::Point2f* &motionDetails, int blockSize, int stepSize, int width, int height, int wB, int hB) {
+		ExhaustiveSearch(CostFunction::ADS, curr, ref, motionVectors, motionDetails, blockSize, stepSize, width, height, wB, hB);
+	}
+
+	void FullExhastiveSAD(cv::Mat& curr, cv::Mat& ref, cv::Point* &motionVectors, cv::Point2f* &motionDetails, int blockSize, int stepSize, int width, int height, int wB, int hB) {
+		ExhaustiveSearch(CostFunction::SAD, curr, ref, motionVectors, motionDetails, blockSize, stepSize, width, height, wB, hB);
+	}
+
+	void FullExhastiveSSD(cv::Mat& curr, cv::Mat& ref, cv::Point* &motionVectors, cv::Point2f* &motionDetails, int blockSize, int stepSize, int width, int height, int wB, int hB) {
+		ExhaustiveSearch(CostFunction::SSD, curr, ref, motionVectors, motionDetails, blockSize, stepSize, width, height, wB, hB);
+	}
+
+	//Blocks do not overlap (stepSize == blockSize) and the whole window is searched
+	void NaiveFullExhastive(cv::Mat& curr, cv::Mat& ref, cv::Point* &motionVectors, int blockSize, int width, int height, int wB, int hB) {
+		ExhaustiveSearch(CostFunction::SAD, curr, ref, motionVectors, nullptr, blockSize, blockSize, width, height, wB, hB, false);
 	}
 }
\ No newline at end of file
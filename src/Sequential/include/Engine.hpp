@@ -0,0 +1,146 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <opencv2/opencv.hpp>
+
+#include "ThreadPool.hpp"
+#include "MotionField.hpp"
+#include "BlockMatching.hpp"
+#include "IntegralADS.hpp"
+#include "SuccessiveElimination.hpp"
+#include "ParallelBlockMatching.hpp"
+#include "SearchStrategy.hpp"
+#include "PyramidSearch.hpp"
+#include "PredictiveSearch.hpp"
+
+namespace BlockMatching {
+	//Every CPU engine behind a single Match call. The pyramid and predictive searches take precedence over a search
+	//strategy, which takes precedence over the method. Engines keep state from the previous pair (summed area tables,
+	//the previous field) so every change of selection resets them, as should the caller when pairs aren't consecutive.
+	class Engine {
+	public:
+		//Methods: 0 SAD, 1 ADS (integral image), 2 SSD, 3 SAD (successive elimination)
+		static const int MethodCount = 4;
+
+		Engine() : strategies(GetSearchStrategies()) {};
+
+		//Returns the number of candidates evaluated by the engines that prune or skip them, -1 for the exhaustive methods
+		//which evaluate every candidate of the window
+		long long Match(ThreadPool * pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+			if (this->use_pyramid)
+				return this->pyramid.Match(pool, curr, ref, field);
+			else if (this->use_predictive)
+				return this->predictive.Match(pool, curr, ref, field, width, height);
+			else if (this->strategy != 0)
+				return StrategySearch(*this->strategies[this->strategy], pool, curr, ref, field, width, height);
+			else if (this->method == 3)
+				return this->sea.Match(pool, curr, ref, field, width, height);
+			else if (this->method == 1 && pool)
+				ParallelIntegralADS(*pool, this->ads, curr, ref, field, width, height);
+			else if (this->method == 1)
+				this->ads.Match(curr, ref, field, width, height);
+			else
+				ExhaustiveSearch(this->method == 0 ? CostFunction::SAD : CostFunction::SSD, pool, curr, ref, field, width, height);
+
+			return -1;
+		};
+
+		//Engines that keep state from the previous frame, that state is stale after a seek or after other engines have run
+		void Reset() {
+			this->ads.Reset();
+			this->sea.Reset();
+			this->pyramid.Reset();
+			this->predictive.Reset();
+		};
+
+		//Names accepted by --engine, strategies are selected by their index in GetSearchStrategies
+		bool Select(const std::string& name) {
+			const char * strategy_names[] = { "full", "tss", "ntss", "diamond", "hexagon" };
+
+			if (name == "sad")
+				this->method = 0;
+			else if (name == "ads")
+				this->method = 1;
+			else if (name == "ssd")
+				this->method = 2;
+			else if (name == "sea")
+				this->method = 3;
+			else if (name == "pyramid")
+				this->use_pyramid = true;
+			else if (name == "predictive")
+				this->use_predictive = true;
+			else {
+				int found = -1;
+
+				for (int i = 0; i < (int)this->strategies.size() && i < 5; i++)
+					if (name == strategy_names[i])
+						found = i;
+
+				if (found < 0) {
+					std::cerr << "Unknown engine " << name << ", expected sad, ads, ssd, sea, pyramid, predictive, full, tss, ntss, diamond or hexagon" << std::endl;
+					return false;
+				}
+
+				this->strategy = found;
+			}
+
+			this->Reset();
+			return true;
+		};
+
+		void NextMethod() {
+			this->method = (this->method + 1) % MethodCount;
+			this->Reset();
+		};
+
+		void NextStrategy() {
+			this->strategy = (this->strategy + 1) % this->strategies.size();
+			this->Reset();
+		};
+
+		void TogglePyramid() {
+			this->use_pyramid = !this->use_pyramid;
+			this->Reset();
+		};
+
+		void TogglePredictive() {
+			this->use_predictive = !this->use_predictive;
+			this->Reset();
+		};
+
+		//Search Match() performs, for the display
+		std::string GetName() const {
+			const char * method_names[MethodCount] = { "SAD", "ADS", "SSD", "SEA" };
+
+			if (this->use_pyramid)
+				return "Pyramid Search";
+			else if (this->use_predictive)
+				return "Predictive Search";
+			else if (this->strategy != 0)
+				return this->strategies[this->strategy]->GetName();
+
+			return this->strategies[0]->GetName() + " (" + method_names[this->method] + ")";
+		};
+	private:
+		//Integral image ADS engine, keeps the summed area table of the last frame between iterations
+		IntegralADS ads;
+
+		//Exact SAD pruned with block sums, keeps the summed area table of the last frame like the ADS engine
+		SuccessiveElimination sea;
+
+		//Search strategies, the first is the full search performed by the selected method
+		std::vector<std::shared_ptr<SearchStrategy>> strategies;
+
+		//Coarse to fine pyramid search, covers motion larger than the block size
+		PyramidSearch pyramid;
+
+		//Search seeded from the previous motion field
+		PredictiveSearch predictive;
+
+		int method = 0, strategy = 0;
+		bool use_pyramid = false, use_predictive = false;
+	};
+}
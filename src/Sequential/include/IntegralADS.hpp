@@ -0,0 +1,137 @@
+#pragma once
+#include <utility>
+
+#include <opencv2/opencv.hpp>
+
+#include "BlockMatching.hpp"
+
+namespace BlockMatching {
+	//Summed area table of a grayscale frame, any rectangular sum is four lookups
+	class IntegralImage {
+	public:
+		void Compute(const cv::Mat& img) {
+			cv::integral(img, this->sum, CV_32S);
+		}
+
+		inline int BlockSum(int x, int y, int w, int h) const {
+			const int * top = this->sum.ptr<int>(y);
+			const int * bottom = this->sum.ptr<int>(y + h);
+			return bottom[x + w] - bottom[x] - top[x + w] + top[x];
+		}
+
+		inline int BlockSum(const cv::Point& p, int blockSize) const {
+			return BlockSum(p.x, p.y, blockSize, blockSize);
+		}
+
+		bool Empty() const {
+			return this->sum.empty();
+		}
+
+		//Size of the frame the table was computed from (table is one larger in each dimension)
+		cv::Size Size() const {
+			return this->sum.empty() ? cv::Size() : cv::Size(this->sum.cols - 1, this->sum.rows - 1);
+		}
+
+		void Swap(IntegralImage& other) {
+			std::swap(this->sum, other.sum);
+		}
+	private:
+		cv::Mat sum;
+	};
+
+	inline cv::Vec3i ClosestNeighbour(const IntegralImage& prev, const cv::Point& currPoint, const int sWindow, const int width, const int height, const int blockSize) {
+		for (int row = -sWindow; row < sWindow; row += sWindow) {
+			for (int col = -sWindow; col < sWindow; col += sWindow) {
+				cv::Point refPoint(currPoint.x + row, currPoint.y + col);
+				//Check if the block is within the bounds to avoid incorrect values
+				if (IsInBounds(refPoint.x, refPoint.y, width, height, blockSize)) {
+					return cv::Vec3i(row, col, prev.BlockSum(refPoint, blockSize));
+				}
+			}
+		}
+
+		return cv::Vec3i(0, 0, prev.BlockSum(currPoint, blockSize));
+	}
+
+	//FullExhastiveADS backed by one integral image per frame so every block sum is O(1) regardless of blockSize.
+	//The table built for curr is kept and used as the reference table on the next call, call Reset() whenever
+	//the next ref is not the current curr (seeking, looping or changing the ROI).
+	class IntegralADS {
+	public:
+		void Match(const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+			this->Prepare(curr, ref);
+			field.Invalidate();
+
+			//Loop over all possible blocks in frame
+			for (int x = 0; x < field.GetWB(); x++) {
+				for (int y = 0; y < field.GetHB(); y++) {
+					this->MatchBlock(field, x, y, width, height);
+				}
+			}
+
+			this->Advance();
+		}
+
+		//Build the tables for a frame pair, split out of Match so blocks can be distributed over threads
+		void Prepare(const cv::Mat& curr, const cv::Mat& ref) {
+			if (!this->reuse || this->refSum.Size() != ref.size())
+				this->refSum.Compute(ref);
+
+			this->currSum.Compute(curr);
+		}
+
+		void MatchBlock(MotionField& field, int x, int y, int width, int height) const {
+			const int blockSize = field.GetBlockSize();
+
+			//Reference point on current frame that will be searched for in the previous frame
+			const cv::Point currPoint(x * field.GetStepSize(), y * field.GetStepSize());
+
+			int current_err = this->currSum.BlockSum(currPoint, blockSize);
+
+			const int sWindow = blockSize;
+			cv::Vec3i closest = ClosestNeighbour(this->refSum, currPoint, sWindow, width, height, blockSize);
+
+			float distanceToBlock = FLT_MAX;
+			int bestErr = INT_MAX, err;
+			cv::Point best;
+
+			//Loop over all possible blocks within each macroblock
+			for (int row = closest[0]; row < sWindow; row++) {
+				for (int col = closest[1]; col < sWindow; col++) {
+					//Refererence a block to search on the previous frame
+					cv::Point refPoint(currPoint.x + row, currPoint.y + col);
+
+					//Check if it lays within the bounds of the capture
+					if (IsInBounds(refPoint.x, refPoint.y, width, height, blockSize)) {
+						err = AbsoluteDifference(current_err, this->refSum.BlockSum(refPoint, blockSize));
+
+						//Take the lowest error, closeness is preffered.
+						float newDistance = euclideanDistance(refPoint.x, currPoint.x, refPoint.y, currPoint.y);
+
+						//Keep the lowest error
+						if (err < bestErr || (err == bestErr && newDistance <= distanceToBlock)) {
+							bestErr = err;
+							distanceToBlock = newDistance;
+							best = cv::Point(row, col);
+						}
+					}
+				}
+			}
+
+			StoreBest(field, x + y * field.GetWB(), best, distanceToBlock == FLT_MAX ? LLONG_MAX : bestErr);
+		}
+
+		//Current frame becomes the reference frame of the next pair
+		void Advance() {
+			this->currSum.Swap(this->refSum);
+			this->reuse = true;
+		}
+
+		void Reset() {
+			this->reuse = false;
+		}
+	private:
+		IntegralImage currSum, refSum;
+		bool reuse = false;
+	};
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+
+#include "ThreadPool.hpp"
+#include "BlockMatching.hpp"
+#include "IntegralADS.hpp"
+
+namespace BlockMatching {
+	//Multi-threaded variants of the sequential engines, blocks are matched in tiles on the pool (see ForEachBlock)
+	void ParallelFullExhastiveSAD(ThreadPool& pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+		ExhaustiveSearch(CostFunction::SAD, &pool, curr, ref, field, width, height);
+	}
+
+	void ParallelFullExhastiveADS(ThreadPool& pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+		ExhaustiveSearch(CostFunction::ADS, &pool, curr, ref, field, width, height);
+	}
+
+	void ParallelFullExhastiveSSD(ThreadPool& pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+		ExhaustiveSearch(CostFunction::SSD, &pool, curr, ref, field, width, height);
+	}
+
+	//field must have been sized with stepSize == blockSize
+	void ParallelNaiveFullExhastive(ThreadPool& pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+		ExhaustiveSearch(CostFunction::SAD, &pool, curr, ref, field, width, height, false);
+	}
+
+	void ParallelIntegralADS(ThreadPool& pool, IntegralADS& ads, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+		ads.Prepare(curr, ref);
+		field.Invalidate();
+
+		ForEachBlock(&pool, field.GetWB(), field.GetHB(), [&](int x, int y) {
+			ads.MatchBlock(field, x, y, width, height);
+		});
+
+		ads.Advance();
+	}
+}
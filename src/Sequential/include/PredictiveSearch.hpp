@@ -0,0 +1,112 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <climits>
+
+#include <opencv2/opencv.hpp>
+
+#include "ThreadPool.hpp"
+#include "BlockMatching.hpp"
+#include "SearchStrategy.hpp"
+
+namespace BlockMatching {
+	//Predictive zonal search in the style of EPZS. The motion field of the previous pair is kept and for every block the
+	//zero vector, the co-located vector and the vectors of its four neighbours are tested first, followed by a small diamond
+	//descent from the best of them. If the error is still above a threshold adapted from the previous error of the block the
+	//full search is used instead. Predictors are only taken from the previous field so the result does not depend on the
+	//order blocks are matched in when running on the pool. Call Reset() whenever consecutive calls are not consecutive pairs.
+	class PredictiveSearch {
+	public:
+		//Fallback when the error exceeds previous error * thresholdScale + thresholdOffset per pixel of the block
+		PredictiveSearch(float thresholdScale = 1.5f, int thresholdOffset = 1) {
+			this->thresholdScale = thresholdScale;
+			this->thresholdOffset = thresholdOffset;
+		};
+
+		//Returns the number of SAD evaluations performed
+		long long Match(ThreadPool * pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+			const int wB = field.GetWB(), hB = field.GetHB(), blockSize = field.GetBlockSize(), stepSize = field.GetStepSize();
+
+			//Vectors of a different grid can't be used as predictors
+			if (wB != this->wB || hB != this->hB || blockSize != this->blockSize) {
+				this->wB = wB;
+				this->hB = hB;
+				this->blockSize = blockSize;
+				this->reuse = false;
+			}
+
+			this->currField.resize(wB * hB);
+			this->currCost.resize(wB * hB);
+
+			std::atomic<long long> evaluations(0);
+			field.Invalidate();
+
+			ForEachBlock(pool, wB, hB, [&](int x, int y) {
+				BlockSearch search(curr, ref, cv::Point(x * stepSize, y * stepSize), blockSize, width, height);
+				int idx = x + y * wB;
+
+				if (this->reuse)
+					this->SearchBlock(search, x, y);
+				else
+					FullSearch().Search(search);
+
+				search.Store(field, idx);
+				this->currField[idx] = search.GetBest();
+				this->currCost[idx] = search.GetBestErr();
+				evaluations += search.GetEvaluations();
+			});
+
+			std::swap(this->currField, this->prevField);
+			std::swap(this->currCost, this->prevCost);
+			this->reuse = true;
+
+			return evaluations;
+		}
+
+		void Reset() {
+			this->reuse = false;
+		}
+	private:
+		std::vector<cv::Point> currField, prevField;
+		std::vector<long long> currCost, prevCost;
+		float thresholdScale;
+		int thresholdOffset, wB = 0, hB = 0, blockSize = 0;
+		bool reuse = false;
+
+		void SearchBlock(BlockSearch& search, int x, int y) const {
+			int idx = x + y * this->wB;
+
+			search.Test(cv::Point(0, 0));
+			search.Test(this->prevField[idx]);
+
+			if (x > 0)
+				search.Test(this->prevField[idx - 1]);
+			if (x < this->wB - 1)
+				search.Test(this->prevField[idx + 1]);
+			if (y > 0)
+				search.Test(this->prevField[idx - this->wB]);
+			if (y < this->hB - 1)
+				search.Test(this->prevField[idx + this->wB]);
+
+			//A move needs a lower error or an equal error closer to the block, the cap only guards against ties cycling
+			const int maxMoves = 4 * search.GetWindow();
+			cv::Point centre = search.GetBest();
+
+			for (int i = 0; i < maxMoves; i++) {
+				search.TestPattern(centre, SmallDiamondPattern, 4);
+
+				if (search.GetBest() == centre)
+					break;
+
+				centre = search.GetBest();
+			}
+
+			long long previous = this->prevCost[idx] == LLONG_MAX ? 0 : this->prevCost[idx];
+			long long threshold = (long long)(previous * this->thresholdScale) + (long long)this->thresholdOffset * this->blockSize * this->blockSize;
+
+			//Predictors failed, e.g. at the start of a contraction, search the whole window
+			if (search.GetBestErr() > threshold)
+				FullSearch().Search(search);
+		}
+	};
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include <opencv2/opencv.hpp>
+
+#include "ThreadPool.hpp"
+#include "BlockMatching.hpp"
+#include "SearchStrategy.hpp"
+
+namespace BlockMatching {
+	//Hierarchical coarse-to-fine motion estimation. Each block is first matched at the coarsest level of an image pyramid
+	//with a small window, the vector is then doubled and refined by +-refineWindow pixels on every finer level. The motion
+	//range is coarseWindow * 2^levels pixels regardless of blockSize, at a cost of a few small searches per block.
+	//Like IntegralADS the pyramid of curr is kept as the ref pyramid of the next call, call Reset() when that is not the case.
+	class PyramidSearch {
+	public:
+		PyramidSearch(int levels = 2, int coarseWindow = 4, int refineWindow = 2) {
+			this->levels = levels;
+			this->coarseWindow = coarseWindow;
+			this->refineWindow = refineWindow;
+		};
+
+		//Returns the number of SAD evaluations performed over every level
+		long long Match(ThreadPool * pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field) {
+			if (!this->reuse || this->refPyramid.empty() || this->refPyramid[0].size() != ref.size() || (int)this->refPyramid.size() != this->levels + 1)
+				cv::buildPyramid(ref, this->refPyramid, this->levels);
+
+			cv::buildPyramid(curr, this->currPyramid, this->levels);
+
+			std::atomic<long long> evaluations(0);
+			field.Invalidate();
+
+			ForEachBlock(pool, field.GetWB(), field.GetHB(), [&](int x, int y) {
+				evaluations += this->MatchBlock(field, x, y);
+			});
+
+			//Current frame becomes the reference frame of the next pair
+			std::swap(this->currPyramid, this->refPyramid);
+			this->reuse = true;
+
+			return evaluations;
+		}
+
+		void Reset() {
+			this->reuse = false;
+		}
+
+		int GetLevels() {
+			return this->levels;
+		}
+
+		void SetLevels(int levels) {
+			this->levels = std::max(0, levels);
+			this->reuse = false;
+		}
+	private:
+		std::vector<cv::Mat> currPyramid, refPyramid;
+		int levels, coarseWindow, refineWindow;
+		bool reuse = false;
+
+		int MatchBlock(MotionField& field, int x, int y) const {
+			const int blockSize = field.GetBlockSize();
+			const cv::Point currPoint(x * field.GetStepSize(), y * field.GetStepSize());
+			cv::Point d(0, 0);
+			int evaluations = 0;
+
+			for (int l = this->levels; l >= 0; l--) {
+				const cv::Mat& c = this->currPyramid[l];
+				const cv::Mat& r = this->refPyramid[l];
+
+				//The block keeps its size on every level so coarse blocks cover a larger area and carry more texture
+				int size = std::min(blockSize, std::min(c.cols, c.rows) - 1);
+				cv::Point p(std::min(currPoint.x >> l, c.cols - size), std::min(currPoint.y >> l, c.rows - size));
+				int window = l == this->levels ? this->coarseWindow : this->refineWindow;
+
+				//The displacement limit only needs to cover the prediction plus this level's window
+				BlockSearch search(c, r, p, size, c.cols, c.rows, std::abs(d.x) + std::abs(d.y) + window + 1);
+
+				for (int row = -window; row <= window; row++) {
+					for (int col = -window; col <= window; col++) {
+						search.Test(cv::Point(d.x + row, d.y + col));
+					}
+				}
+
+				d = search.GetBest();
+				evaluations += search.GetEvaluations();
+
+				if (l == 0) {
+					search.Store(field, x + y * field.GetWB());
+					break;
+				}
+
+				d = cv::Point(d.x * 2, d.y * 2);
+			}
+
+			return evaluations;
+		}
+	};
+}
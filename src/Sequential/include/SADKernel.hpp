@@ -0,0 +1,108 @@
+#pragma once
+#include <cstring>
+
+#include <opencv2/opencv.hpp>
+
+//Select the widest instruction set the compiler has been told it may use
+#if defined(__AVX2__)
+#define BM_SIMD_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BM_SIMD_SSE2
+#endif
+
+#if defined(BM_SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(BM_SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace BlockMatching {
+	//Name of the code path BlockSAD was compiled with
+	inline const char * SADKernelName() {
+#if defined(BM_SIMD_AVX2)
+		return "AVX2";
+#elif defined(BM_SIMD_SSE2)
+		return "SSE2";
+#else
+		return "Scalar";
+#endif
+	}
+
+	//Sum of absolute differences between two w * h blocks of 8-bit pixels, a and b point at the top left pixel
+	//of each block and aStep/bStep are the row strides in bytes. Reads only pixels inside the blocks and allocates nothing.
+	inline int BlockSAD(const uchar * a, size_t aStep, const uchar * b, size_t bStep, int w, int h) {
+		int sum = 0;
+
+#if defined(BM_SIMD_AVX2)
+		__m256i acc256 = _mm256_setzero_si256();
+#endif
+#if defined(BM_SIMD_SSE2)
+		__m128i acc128 = _mm_setzero_si128();
+#endif
+
+		for (int y = 0; y < h; y++, a += aStep, b += bStep) {
+			int x = 0;
+
+#if defined(BM_SIMD_AVX2)
+			for (; x + 32 <= w; x += 32) {
+				__m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + x));
+				__m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + x));
+				acc256 = _mm256_add_epi64(acc256, _mm256_sad_epu8(va, vb));
+			}
+#endif
+#if defined(BM_SIMD_SSE2)
+			//psadbw leaves two 64 bit partial sums per 16 bytes
+			for (; x + 16 <= w; x += 16) {
+				__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + x));
+				__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x));
+				acc128 = _mm_add_epi64(acc128, _mm_sad_epu8(va, vb));
+			}
+
+			//Partial loads zero the upper lanes of both operands so they add nothing to the sum
+			if (x + 8 <= w) {
+				__m128i va = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(a + x));
+				__m128i vb = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(b + x));
+				acc128 = _mm_add_epi64(acc128, _mm_sad_epu8(va, vb));
+				x += 8;
+			}
+
+			if (x + 4 <= w) {
+				int ia, ib;
+				std::memcpy(&ia, a + x, sizeof(int));
+				std::memcpy(&ib, b + x, sizeof(int));
+				acc128 = _mm_add_epi64(acc128, _mm_sad_epu8(_mm_cvtsi32_si128(ia), _mm_cvtsi32_si128(ib)));
+				x += 4;
+			}
+#endif
+
+			for (; x < w; x++)
+				sum += a[x] < b[x] ? b[x] - a[x] : a[x] - b[x];
+		}
+
+#if defined(BM_SIMD_AVX2)
+		acc128 = _mm_add_epi64(acc128, _mm_add_epi64(_mm256_castsi256_si128(acc256), _mm256_extracti128_si256(acc256, 1)));
+#endif
+#if defined(BM_SIMD_SSE2)
+		sum += _mm_cvtsi128_si32(acc128) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc128, acc128));
+#endif
+
+		return sum;
+	}
+
+	//BlockSAD accumulated a row at a time that stops as soon as the running sum exceeds limit, in which case the
+	//returned value is a partial sum only known to be greater than limit. Any sum <= limit is exact.
+	inline int BlockSADBounded(const uchar * a, size_t aStep, const uchar * b, size_t bStep, int w, int h, int limit) {
+		int sum = 0;
+
+		for (int y = 0; y < h; y++, a += aStep, b += bStep) {
+			sum += BlockSAD(a, aStep, b, bStep, w, 1);
+
+			if (sum > limit)
+				break;
+		}
+
+		return sum;
+	}
+}
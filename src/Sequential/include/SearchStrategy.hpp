@@ -0,0 +1,237 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <climits>
+#include <cfloat>
+
+#include <opencv2/opencv.hpp>
+
+#include "ThreadPool.hpp"
+#include "BlockMatching.hpp"
+
+namespace BlockMatching {
+	//Search state of one current block, tests candidate displacements within [-sWindow, sWindow)^2 and keeps the best
+	//using the same error then distance ordering as the exhaustive search. sWindow defaults to blockSize like the other engines.
+	class BlockSearch {
+	public:
+		BlockSearch(const cv::Mat& curr, const cv::Mat& ref, const cv::Point& currPoint, int blockSize, int width, int height, int sWindow = 0)
+			: cost(curr, ref, currPoint, blockSize), currPoint(currPoint), best(0, 0) {
+			this->blockSize = blockSize;
+			this->sWindow = sWindow > 0 ? sWindow : blockSize;
+			this->width = width;
+			this->height = height;
+		}
+
+		//Returns false when the displacement is outside the search window or frame
+		bool Test(const cv::Point& d) {
+			if (d.x < -this->sWindow || d.x >= this->sWindow || d.y < -this->sWindow || d.y >= this->sWindow)
+				return false;
+
+			cv::Point refPoint(this->currPoint.x + d.x, this->currPoint.y + d.y);
+
+			if (!IsInBounds(refPoint.x, refPoint.y, this->width, this->height, this->blockSize))
+				return false;
+
+			//Candidates that can't win only need to be evaluated until they pass the best error
+			long long err = this->cost(refPoint, this->bestErr);
+			float distance = euclideanDistance(refPoint.x, this->currPoint.x, refPoint.y, this->currPoint.y);
+			this->evaluations++;
+
+			if (err < this->bestErr || (err == this->bestErr && distance <= this->distanceToBlock)) {
+				this->bestErr = err;
+				this->distanceToBlock = distance;
+				this->best = d;
+			}
+
+			return true;
+		}
+
+		//Test every offset of a search pattern centred on c
+		void TestPattern(const cv::Point& c, const cv::Point * pattern, int count, int scale = 1) {
+			for (int i = 0; i < count; i++)
+				this->Test(cv::Point(c.x + pattern[i].x * scale, c.y + pattern[i].y * scale));
+		}
+
+		cv::Point GetBest() const { return this->best; }
+		long long GetBestErr() const { return this->bestErr; }
+		int GetWindow() const { return this->sWindow; }
+		int GetEvaluations() const { return this->evaluations; }
+
+		//Write the result in the same form as the exhaustive engines, no in bound candidate leaves the block stationary
+		void Store(MotionField& field, int idx) const {
+			StoreBest(field, idx, this->best, this->bestErr);
+		}
+	private:
+		const SADCost<0> cost;
+		cv::Point currPoint, best;
+		int blockSize, sWindow, width, height, evaluations = 0;
+		long long bestErr = LLONG_MAX;
+		float distanceToBlock = FLT_MAX;
+	};
+
+	//Interface for the search performed for each block, the full search and the fast searches below implement it
+	class SearchStrategy {
+	public:
+		virtual ~SearchStrategy() {}
+
+		virtual std::string GetName() const = 0;
+
+		virtual void Search(BlockSearch& search) const = 0;
+	};
+
+	class FullSearch : public SearchStrategy {
+	public:
+		std::string GetName() const { return "Full Search"; }
+
+		void Search(BlockSearch& search) const {
+			const int s = search.GetWindow();
+
+			for (int row = -s; row < s; row++) {
+				for (int col = -s; col < s; col++) {
+					search.Test(cv::Point(row, col));
+				}
+			}
+		}
+	};
+
+	//Eight neighbours of a point at distance one
+	static const cv::Point SquarePattern[8] = {
+		cv::Point(-1, -1), cv::Point(0, -1), cv::Point(1, -1), cv::Point(-1, 0),
+		cv::Point(1, 0), cv::Point(-1, 1), cv::Point(0, 1), cv::Point(1, 1)
+	};
+
+	//Largest power of two not above half the search window, the first step of the logarithmic searches
+	inline int InitialStep(int sWindow) {
+		int step = 1;
+		while (step * 2 <= sWindow / 2)
+			step *= 2;
+		return step;
+	}
+
+	//Koga et al. three-step search, the eight neighbours at a halving step around the best point so far
+	class ThreeStepSearch : public SearchStrategy {
+	public:
+		std::string GetName() const { return "Three Step Search"; }
+
+		void Search(BlockSearch& search) const {
+			search.Test(cv::Point(0, 0));
+
+			for (int step = InitialStep(search.GetWindow()); step >= 1; step /= 2)
+				search.TestPattern(search.GetBest(), SquarePattern, 8, step);
+		}
+	};
+
+	//Li, Zeng and Liou new three-step search, adds a step one ring around the centre and stops early for
+	//stationary or nearly stationary blocks which dominate most sequences
+	class NewThreeStepSearch : public SearchStrategy {
+	public:
+		std::string GetName() const { return "New Three Step Search"; }
+
+		void Search(BlockSearch& search) const {
+			const cv::Point centre(0, 0);
+			int step = InitialStep(search.GetWindow());
+
+			search.Test(centre);
+			search.TestPattern(centre, SquarePattern, 8, step);
+
+			if (step > 1)
+				search.TestPattern(centre, SquarePattern, 8);
+
+			cv::Point best = search.GetBest();
+
+			if (best == centre)
+				return;
+
+			//Best point is on the inner ring, check its own neighbours and stop
+			if (std::abs(best.x) <= 1 && std::abs(best.y) <= 1) {
+				search.TestPattern(best, SquarePattern, 8);
+				return;
+			}
+
+			for (step /= 2; step >= 1; step /= 2)
+				search.TestPattern(search.GetBest(), SquarePattern, 8, step);
+		}
+	};
+
+	//Repeat a large pattern around the best point until the centre wins, then refine once with a small pattern
+	inline void PatternDescent(BlockSearch& search, const cv::Point * large, int largeCount, const cv::Point * small, int smallCount) {
+		search.Test(cv::Point(0, 0));
+
+		//A move needs a lower error or an equal error closer to the block, the cap only guards against ties cycling
+		const int maxMoves = 4 * search.GetWindow();
+		cv::Point centre = search.GetBest();
+
+		for (int i = 0; i < maxMoves; i++) {
+			search.TestPattern(centre, large, largeCount);
+
+			if (search.GetBest() == centre)
+				break;
+
+			centre = search.GetBest();
+		}
+
+		search.TestPattern(centre, small, smallCount);
+	}
+
+	static const cv::Point LargeDiamondPattern[8] = {
+		cv::Point(0, -2), cv::Point(-1, -1), cv::Point(1, -1), cv::Point(-2, 0),
+		cv::Point(2, 0), cv::Point(-1, 1), cv::Point(1, 1), cv::Point(0, 2)
+	};
+
+	static const cv::Point SmallDiamondPattern[4] = {
+		cv::Point(0, -1), cv::Point(-1, 0), cv::Point(1, 0), cv::Point(0, 1)
+	};
+
+	//Zhu and Ma diamond search
+	class DiamondSearch : public SearchStrategy {
+	public:
+		std::string GetName() const { return "Diamond Search"; }
+
+		void Search(BlockSearch& search) const {
+			PatternDescent(search, LargeDiamondPattern, 8, SmallDiamondPattern, 4);
+		}
+	};
+
+	static const cv::Point LargeHexagonPattern[6] = {
+		cv::Point(-2, 0), cv::Point(-1, -2), cv::Point(1, -2),
+		cv::Point(2, 0), cv::Point(1, 2), cv::Point(-1, 2)
+	};
+
+	//Zhu, Lin and Chau hexagon-based search, fewer points per move than the diamond for the same coverage
+	class HexagonSearch : public SearchStrategy {
+	public:
+		std::string GetName() const { return "Hexagon Search"; }
+
+		void Search(BlockSearch& search) const {
+			PatternDescent(search, LargeHexagonPattern, 6, SmallDiamondPattern, 4);
+		}
+	};
+
+	//All strategies in the order they are cycled through at runtime
+	inline std::vector<std::shared_ptr<SearchStrategy>> GetSearchStrategies() {
+		std::vector<std::shared_ptr<SearchStrategy>> strategies;
+		strategies.push_back(std::make_shared<FullSearch>());
+		strategies.push_back(std::make_shared<ThreeStepSearch>());
+		strategies.push_back(std::make_shared<NewThreeStepSearch>());
+		strategies.push_back(std::make_shared<DiamondSearch>());
+		strategies.push_back(std::make_shared<HexagonSearch>());
+		return strategies;
+	}
+
+	//Run a strategy for every block with the SAD criterion, returns the number of SAD evaluations performed
+	long long StrategySearch(const SearchStrategy& strategy, ThreadPool * pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+		std::atomic<long long> evaluations(0);
+		field.Invalidate();
+
+		ForEachBlock(pool, field.GetWB(), field.GetHB(), [&](int x, int y) {
+			BlockSearch search(curr, ref, cv::Point(x * field.GetStepSize(), y * field.GetStepSize()), field.GetBlockSize(), width, height);
+			strategy.Search(search);
+			search.Store(field, x + y * field.GetWB());
+			evaluations += search.GetEvaluations();
+		});
+
+		return evaluations;
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <vector>
+#include <atomic>
+
+#include <opencv2/opencv.hpp>
+
+#include "ThreadPool.hpp"
+#include "BlockMatching.hpp"
+#include "IntegralADS.hpp"
+
+namespace BlockMatching {
+	//SAD bounded from below by block sums, |sum(A) - sum(B)| <= SAD(A, B). The bound of the whole block is tried first, then the
+	//tighter sum of the bounds of its four quadrants, and the SAD itself is only accumulated for candidates that pass both.
+	//Follows the PartialDistortion contract so anything greater than the limit may be returned for a pruned candidate.
+	//Candidates that reach the SAD are counted, a cost is used by one block on one thread.
+	class SEACost {
+	public:
+		SEACost(const cv::Mat& curr, const cv::Mat& ref, const IntegralImage& currSum, const IntegralImage& refSum, const cv::Point& currPoint, int blockSize)
+			: sad(curr, ref, currPoint, blockSize), refSum(refSum) {
+			this->size = blockSize;
+			this->half = blockSize / 2;
+			this->current = currSum.BlockSum(currPoint, blockSize);
+
+			for (int q = 0; q < 4; q++)
+				this->quadrants[q] = this->QuadrantSum(currSum, currPoint, q);
+		}
+
+		inline long long operator()(const cv::Point& refPoint, long long limit) const {
+			long long bound = AbsoluteDifference(this->current, this->refSum.BlockSum(refPoint, this->size));
+
+			if (bound > limit)
+				return bound;
+
+			//Blocks of one pixel have no quadrants
+			if (this->half > 0) {
+				bound = 0;
+				for (int q = 0; q < 4; q++)
+					bound += AbsoluteDifference(this->quadrants[q], this->QuadrantSum(this->refSum, refPoint, q));
+
+				if (bound > limit)
+					return bound;
+			}
+
+			this->evaluations++;
+			return this->sad(refPoint, limit);
+		}
+
+		int GetEvaluations() const {
+			return this->evaluations;
+		}
+	private:
+		const SADCost<0> sad;
+		const IntegralImage& refSum;
+		int size, half, current, quadrants[4];
+		mutable int evaluations = 0;
+
+		//Quadrants split at half, the right and bottom ones take the extra row and column of odd sizes
+		inline int QuadrantSum(const IntegralImage& img, const cv::Point& p, int q) const {
+			int left = q & 1 ? this->half : 0, top = q & 2 ? this->half : 0;
+			int w = q & 1 ? this->size - this->half : this->half, h = q & 2 ? this->size - this->half : this->half;
+			return img.BlockSum(p.x + left, p.y + top, w, h);
+		}
+	};
+
+	//Exact SAD full search using multilevel successive elimination, the motion field is identical to FullExhastiveSAD.
+	//Like IntegralADS the table of curr is kept as the ref table of the next call, call Reset() when that is not the case.
+	class SuccessiveElimination {
+	public:
+		//Returns the number of candidates whose SAD was accumulated, those not eliminated by the block sums
+		long long Match(ThreadPool * pool, const cv::Mat& curr, const cv::Mat& ref, MotionField& field, int width, int height) {
+			const int blockSize = field.GetBlockSize(), stepSize = field.GetStepSize();
+
+			if (!this->reuse || this->refSum.Size() != ref.size())
+				this->refSum.Compute(ref);
+
+			this->currSum.Compute(curr);
+
+			if (this->orderWindow != blockSize) {
+				this->order = SpiralOrder(blockSize);
+				this->orderWindow = blockSize;
+			}
+
+			std::atomic<long long> evaluations(0);
+			field.Invalidate();
+
+			ForEachBlock(pool, field.GetWB(), field.GetHB(), [&](int x, int y) {
+				const cv::Point currPoint(x * stepSize, y * stepSize);
+				const SEACost cost(curr, ref, this->currSum, this->refSum, currPoint, blockSize);
+
+				SpiralSearch(cost, field, x + y * field.GetWB(), currPoint, blockSize, width, height, true, this->order);
+				evaluations += cost.GetEvaluations();
+			});
+
+			//Current frame becomes the reference frame of the next pair
+			this->currSum.Swap(this->refSum);
+			this->reuse = true;
+
+			return evaluations;
+		}
+
+		void Reset() {
+			this->reuse = false;
+		}
+	private:
+		IntegralImage currSum, refSum;
+		std::vector<cv::Point> order;
+		int orderWindow = 0;
+		bool reuse = false;
+	};
+}
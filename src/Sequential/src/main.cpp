@@ -9,13 +9,145 @@
 //TODO: Uncomment this line
 //#include "Dicom.hpp"
 
-#include "BlockMatching.hpp"
+#include "Engine.hpp"
 #include "Drawing.hpp"
 #include "Capture.hpp"
 #include "Timer.hpp"
 #include "Utils.hpp"
 #include "SimpleGraph.hpp"
 #include "IO.hpp"
+#include "Options.hpp"
+#include "SPSCQueue.hpp"
+#include "FramePipeline.hpp"
+#include "BatchScheduler.hpp"
+#include "HeartRate.hpp"
+#include "MotionRecording.hpp"
+#include "FrameStack.hpp"
+#include "FrameSource.hpp"
+
+//Headless pass over every frame of a study in a batch, the worker running it is its only thread. Returns the pairs matched
+//and the last heart rate estimate in bpm
+long long ProcessStudy(FrameSource& source, const Options& options, const std::string& results_path, float& bpm, StageTimers * latency = NULL) {
+	cv::Rect frame_rect(0, 0, source.GetWidth(), source.GetHeight());
+	cv::Rect roi = options.HasROI() ? options.roi & frame_rect : frame_rect;
+
+	//Each frame is cropped and converted once, then becomes the previous frame of the next pair
+	FramePairs frames(source, roi);
+
+	if (!frames.Next())
+		throw std::runtime_error("Could not read the first frame");
+
+	//Same block size as the applications choose, unless given and valid for this study
+	int width = frames.Curr().cols, height = frames.Curr().rows;
+	std::vector<int> bSizes = Util::getBlockSizes(width, height);
+	int blockSize = bSizes.at(bSizes.size() >= 2 ? 1 : 0);
+
+	if (std::find(bSizes.begin(), bSizes.end(), options.blockSize) != bSizes.end())
+		blockSize = options.blockSize;
+
+	int stepSize = Util::getStepSize(blockSize);
+	cv::Size grid = Util::getBlockGrid(width, height, blockSize, stepSize);
+	MotionField field(grid.width, grid.height, blockSize, stepSize);
+
+	BlockMatching::Engine engine;
+	if (!options.engine.empty())
+		engine.Select(options.engine);
+
+	IO::RecordWriter output_data(results_path, options.tsv);
+	if (!output_data.IsOpen())
+		throw std::runtime_error("Could not create the results file");
+
+	HeartRate heart_rate(options.frameTime > 0 ? 1000.0f / options.frameTime : (float)source.GetFrameRate());
+	long long pairs = 0;
+
+	//A frame is decoded and converted to gray in one read here, recorded as decode
+	auto timed = [latency](StageTimers::Stage stage) {
+		return latency ? (*latency)[stage] : (LatencyHistogram *)NULL;
+	};
+
+	//Every frame the source has, the frame count of a video is only an estimate
+	for (int i = 1; ; i++) {
+		bool read;
+		{
+			ScopedTimer timer(timed(StageTimers::Decode));
+			read = frames.Next();
+		}
+
+		if (!read)
+			break;
+
+		{
+			ScopedTimer timer(timed(StageTimers::Match));
+			engine.Match(nullptr, frames.Curr(), frames.Prev(), field, width, height);
+		}
+
+		ScopedTimer timer(timed(StageTimers::Analyse));
+		cv::Vec4f averages = Util::analyseData(field);
+		output_data.Add(i, averages[0], averages[1], averages[2], averages[3]);
+		heart_rate.Add(averages[3]);
+		pairs++;
+	}
+
+	output_data.Close();
+	bpm = heart_rate.GetBPM();
+	return pairs;
+}
+
+//Writes the ROI of every frame as 8 bit gray to a frame stack so later runs over the study skip decoding. Returns the
+//frames written
+int ConvertStudy(FrameSource& source, const Options& options, const std::string& stack_path) {
+	cv::Rect frame_rect(0, 0, source.GetWidth(), source.GetHeight());
+	cv::Rect roi = options.HasROI() ? options.roi & frame_rect : frame_rect;
+	double frame_time = options.frameTime > 0 ? options.frameTime : source.GetFrameRate() > 0 ? 1000.0 / source.GetFrameRate() : 0;
+
+	FrameStackWriter stack(stack_path, roi.width, roi.height, frame_time, roi);
+	cv::Mat gray;
+
+	for (source.ReadGray(gray, roi); !gray.empty(); source.ReadGray(gray, roi))
+		stack.Add(gray);
+
+	stack.Close();
+	return stack.GetFrameCount();
+}
+
+//Analyses the motion fields of a recording as if they had just been matched, drawn on a blank ROI unless headless.
+//Returns the fields read
+long long ReplayFields(MotionReplay& replay, const Options& options, const std::string& results_path, float& bpm) {
+	MotionField field;
+	IO::RecordWriter output_data(results_path, options.tsv);
+	HeartRate heart_rate(options.frameTime > 0 ? 1000.0f / options.frameTime : (float)replay.GetFrameRate());
+	SimpleGraph motion_graph(1024, 512, 128);
+	std::string winname("Sequential replay");
+	long long fields = 0;
+	int index;
+	char key = ' ';
+
+	if (!options.headless)
+		cv::namedWindow(winname, cv::WINDOW_AUTOSIZE);
+
+	while (key != 27 && replay.Next(field, index)) {
+		cv::Vec4f averages = Util::analyseData(field);
+		output_data.Add(index, averages[0], averages[1], averages[2], averages[3]);
+		heart_rate.Add(averages[3]);
+		fields++;
+
+		if (options.headless)
+			continue;
+
+		cv::Mat display = cv::Mat::zeros(replay.GetHeight(), replay.GetWidth(), CV_8UC3);
+		Draw::MotionVectors(display, field);
+		Draw::BPM(display, heart_rate.GetBPM());
+		motion_graph.AddData(averages[3]);
+
+		cv::imshow(winname, display);
+		motion_graph.Show();
+		key = (char)cv::waitKey(1);
+	}
+
+	output_data.Close();
+	bpm = heart_rate.GetBPM();
+	return fields;
+}
 
 int main(int argc, char **argv)
 {
@@ -30,19 +162,122 @@ int main(int argc, char **argv)
 	std::time_t t = std::time(nullptr);
 	std::string results_path = root_directory + "/results/raw/sequential/" + std::to_string(std::time(nullptr)) + ".txt";
 
-	//Open Video Capture to File
-	//Dicom Capture(dataPath, true);
-	Capture Capture(dataPathVideo);
+	//Input, ROI, block size and engine may be given on the command line, --headless processes the file once without windows
+	Options options(argc, argv);
+	bool headless = options.headless;
+
+	if (!options.input.empty())
+		dataPathVideo = options.input;
 
-	//Allocate Mat for previous and current frame
-	cv::Mat prev, curr, prevGray, currGray;
-	Capture >> curr;
+	//Analyse a motion recording without matching and exit
+	if (!options.replay.empty()) {
+		MotionReplay replay(options.replay);
+		if (!replay.IsOpened())
+			return 1;
+
+		Timer total;
+		total.tic();
+
+		float bpm;
+		long long fields = ReplayFields(replay, options, options.output.empty() ? results_path : options.output, bpm);
+		float seconds = total.getElapsed() / NANO;
+
+		std::cout << "Replayed " << fields << " fields in " << seconds << "s, " << (seconds > 0 ? fields / seconds : 0) << " fields/s, " << bpm << " BPM" << std::endl;
+		return 0;
+	}
+
+	//Preprocess the input into a frame stack and exit
+	if (!options.convert.empty()) {
+		std::unique_ptr<FrameSource> source = FrameSource::Open(dataPathVideo, false, options.decodeThreads);
+		int frames = source ? ConvertStudy(*source, options, options.convert) : 0;
+
+		std::cout << "Wrote " << frames << " frames to " << options.convert << std::endl;
+		return frames > 0 ? 0 : 1;
+	}
+
+	//Every study of a directory or manifest, one results file each in the --output directory
+	if (!options.batch.empty()) {
+		std::string results_directory = options.output.empty() ? root_directory + "/results/raw/sequential" : options.output;
+		BatchScheduler scheduler(options.workers, options.decoders);
+
+		if (!scheduler.AddStudies(options.batch)) {
+			std::cerr << "No studies found in " << options.batch << std::endl;
+			return 1;
+		}
+
+		std::mutex print_lock;
+		std::atomic<long long> total_pairs(0);
+		Timer total;
+		total.tic();
+
+		//Latency of the studies together with --latency, reported once they are done
+		StageTimers batch_timers;
+		StageTimers * batch_latency = options.latency ? &batch_timers : NULL;
+
+		int failed = scheduler.Run([&](const Study& study) {
+			Timer timer;
+			timer.tic();
+
+			std::string study_results = results_directory + "/" + study.GetName() + ".txt";
+			float bpm;
+
+			//Matching only needs the gray ROI, no colour frame is made
+			std::unique_ptr<FrameSource> source = FrameSource::Open(study.path, false, options.decodeThreads, scheduler.GetDecodeBudget());
+			if (!source)
+				throw std::runtime_error("Could not open the study");
+
+			//Frames of a stack are already the ROI it was converted with
+			Options study_options = options;
+			if (study.IsFrameStack())
+				study_options.roi = cv::Rect();
+
+			long long pairs = ProcessStudy(*source, study_options, study_results, bpm, batch_latency);
+
+			float seconds = timer.getElapsed() / NANO;
+			total_pairs += pairs;
+
+			std::lock_guard<std::mutex> lock(print_lock);
+			std::cout << study.path << ": " << pairs << " frames, " << (seconds > 0 ? pairs / seconds : 0) << " frames/s, " << bpm << " BPM" << std::endl;
+		});
+
+		float seconds = total.getElapsed() / NANO;
+		std::cout << "Processed " << scheduler.GetStudies().size() - failed << " studies, " << total_pairs << " frames in " << seconds << "s, "
+			<< (seconds > 0 ? total_pairs / seconds : 0) << " frames/s on " << scheduler.GetWorkerCount() << " workers" << std::endl;
+
+		if (batch_latency)
+			batch_latency->Report(std::cout);
+
+		return failed == 0 ? 0 : 1;
+	}
+
+	if (!options.output.empty())
+		results_path = options.output;
+
+	//Open the video (or frame stack, or DICOM when built with DCMTK), frames are only kept in colour when they are drawn
+	std::unique_ptr<FrameSource> source = FrameSource::Open(dataPathVideo, !headless, options.decodeThreads);
+	if (!source)
+		return 1;
+
+	//Read the first frame for ROI selection, the pipeline crops every frame from the full first frame onwards
+	cv::Mat first, curr;
+	*source >> first;
+	curr = first;
 
 	//Select ROI
 	cv::Rect roi;
 	bool set_roi = true;
 
-	if (set_roi)
+	if (options.HasROI())
+	{
+		roi = options.roi & cv::Rect(0, 0, curr.cols, curr.rows);
+		curr = curr(roi);
+	}
+	else if (headless)
+	{
+		//Whole frame
+		set_roi = false;
+	}
+	else if (set_roi)
 	{
 		std::string winname("Press' Y' or 'y' when ROI selection has been made");
 		cv::namedWindow(winname, cv::WINDOW_AUTOSIZE);
@@ -56,112 +291,264 @@ int main(int argc, char **argv)
 	}
 
 	//Define BM parameters
-	int width = curr.size().width, height = curr.size().height, frame_count = Capture.GetFrameCount();
+	int width = curr.size().width, height = curr.size().height, frame_count = source->GetFrameCount();
+
+	//Heart rate from the average angle of each frame, the frame rate of an AVI converted from DICOM may not be the real one
+	HeartRate heart_rate(options.frameTime > 0 ? 1000.0f / options.frameTime : (float)source->GetFrameRate());
 
 	//Get all possible block sizes
 	std::vector<int> bSizes = Util::getBlockSizes(width, height);
 	int bID = bSizes.size() >= 2 ? 1 : 0, blockSize = bSizes.at(bID);
-	int stepSize = Util::getStepSize(blockSize);
 
-	//Minus one because last block along x * stepSize + y * stepSize * wB will always be out of bounds
-	int wB = (width / blockSize * blockSize / stepSize) - 1, hB = (height / blockSize * blockSize / stepSize) - 1;
+	if (options.blockSize > 0) {
+		std::vector<int>::iterator it = std::find(bSizes.begin(), bSizes.end(), options.blockSize);
 
-	int bCount = wB * hB;
+		if (it != bSizes.end()) {
+			bID = (int)(it - bSizes.begin());
+			blockSize = *it;
+		}
+		else {
+			std::cerr << "Ignoring --block " << options.blockSize << ", it must divide the ROI width and height" << std::endl;
+		}
+	}
+
+	int stepSize = Util::getStepSize(blockSize);
+
+	cv::Size grid = Util::getBlockGrid(width, height, blockSize, stepSize);
+	int wB = grid.width, hB = grid.height;
 
 	//Create output Window and use Sequential as unique winname
 	std::string winname("Sequential");
-	cv::namedWindow(winname, cv::WINDOW_AUTOSIZE);
+
+	if (!headless)
+		cv::namedWindow(winname, cv::WINDOW_AUTOSIZE);
 
 	//Should the image file loop?
-	bool loop = true;
+	bool loop = !headless;
 
 	//Create Timer to time each frame loop and variables for framerate
 	//Log Processed Frames per second and rendered
 	Timer pT(50), rT(50);
 
+	//Latency of every stage with --latency, reported every 10s and at exit
+	StageTimers stage_timers;
+	StageTimers * latency = options.latency ? &stage_timers : NULL;
+	Timer report, draw;
+
 	//Create Real-Time graph to display average angular motion
 	SimpleGraph motion_graph(1024, 512, 128);
 
-	//Create File Writer
-	IO::Writer output_data(results_path);
-	output_data.AddLine("Angle 0-360", "Magnitude");
+	//Results are streamed to disk as frames are analysed
+	IO::RecordWriter output_data(results_path, options.tsv);
+
+	//Every motion field as well when asked to, for --replay
+	std::unique_ptr<MotionRecorder> recorder;
+	if (!options.record.empty())
+		recorder.reset(new MotionRecorder(options.record, width, height, options.frameTime > 0 ? options.frameTime : source->GetFrameRate() > 0 ? 1000.0 / source->GetFrameRate() : 0));
 
 	//Timeout to wait for key press (< 1 Waits indef)
 	int cvWaitTime = 1;
-	char key;
+	char key = ' ';
 
-	bool draw_motion_vectors = false, draw_hsv = false;
+	//Frame pairs matched at once by offline runs, each by its own engine on its own core
+	int pairs = 1;
 
-	do {
-		//Start timer
-		pT.tic();
-		rT.tic();
+	if (options.pairs != 1 && !headless)
+		std::cerr << "Ignoring --pairs, frame pairs are only matched concurrently with --headless" << std::endl;
+	else if (options.pairs != 1)
+		pairs = options.pairs > 0 ? options.pairs : std::max(1u, std::thread::hardware_concurrency());
+
+	//Matching engines, the method, strategy, pyramid and predictive searches of the first are cycled with 'm', 's', 'l' and 'e'
+	std::vector<std::unique_ptr<BlockMatching::Engine>> engines;
 
-		prev = curr.clone(); //TODO: Test skipping frames
-		Capture >> curr;
+	for (int i = 0; i < pairs; i++) {
+		engines.emplace_back(new BlockMatching::Engine());
 
-		//Break if invalid frames and no loop
-		if (prev.empty() || curr.empty()) {
-			//Reset pointer to frame if loop
-			if (loop) {
-				output_data.Write();
+		if (!options.engine.empty())
+			engines.back()->Select(options.engine);
+	}
+
+	//Worker threads for matching tiles of the block grid, toggled with 't'. Concurrent pairs already use every core
+	ThreadPool pool(pairs > 1 ? 1 : std::thread::hardware_concurrency());
+	bool multi_thread = pairs == 1;
+
+	bool draw_motion_vectors = false, draw_hsv = false;
+
+	//Keys that change matching are forwarded to the match stage, which owns the engines and the block configuration
+	SPSCQueue<char> controls(16);
+
+	auto apply_control = [&](char control) {
+		switch (control) {
+		case '+':
+			bID = bID < bSizes.size() - 1 ? bID + 1 : bID;
+			blockSize = bSizes.at(bID);
+			stepSize = Util::getStepSize(blockSize);
+			grid = Util::getBlockGrid(width, height, blockSize, stepSize);
+			wB = grid.width;
+			hB = grid.height;
+			break;
+		case '-':
+			bID = bID > 0 ? bID - 1 : 0;
+			blockSize = bSizes.at(bID);
+			stepSize = Util::getStepSize(blockSize);
+			grid = Util::getBlockGrid(width, height, blockSize, stepSize);
+			wB = grid.width;
+			hB = grid.height;
+			break;
+		case 'm':
+			engines[0]->NextMethod();
+			break;
+		case 't':
+			multi_thread = !multi_thread;
+			break;
+		case 's':
+			engines[0]->NextStrategy();
+			break;
+		case 'l':
+			engines[0]->TogglePyramid();
+			break;
+		case 'e':
+			engines[0]->TogglePredictive();
+			break;
+		default:
+			break;
+		}
+	};
+
+	//Match stage of engine i, only the first takes keys as the others only run headless. Engines keep state from the pair
+	//they matched last (see Engine), which is only of use to the pair that follows it
+	auto match_stage = [&](int i) {
+		BlockMatching::Engine * engine = engines[i].get();
+		int last = -1;
+
+		return FramePipeline::Stage([&, i, engine, last, pT](FramePacket& packet) mutable {
+			char control;
+			while (i == 0 && controls.TryPop(control))
+				apply_control(control);
+
+			//First frame of the input, or of another pass over it, is only the reference frame of the next
+			if (packet.first)
+				return;
+
+			if (packet.index != last + 1)
+				engine->Reset();
+
+			last = packet.index;
+			pT.tic();
+
+			MotionField& motion_field = packet.field;
+			if (motion_field.GetWB() != wB || motion_field.GetHB() != hB || motion_field.GetBlockSize() != blockSize)
+				motion_field.Resize(wB, hB, blockSize, stepSize);
+
+			//Perform Block Matching
+			engine->Match(multi_thread ? &pool : nullptr, packet.gray, packet.prevGray, motion_field, width, height);
+
+			//Clock timer so FPS only covers matching
+			pT.toc();
+			packet.processed_fps = pT.getFPSFromElapsed();
+
+			//Only shown, headless runs don't name it
+			if (!headless)
+				packet.engine = engine->GetName();
+		});
+	};
+
+	std::vector<FramePipeline::Stage> match_stages;
+	for (int i = 0; i < pairs; i++)
+		match_stages.push_back(match_stage(i));
+
+	//Decode, convert, match and analyse run on their own threads, this thread renders. Concurrent pairs are dealt in runs
+	//of consecutive frames so engines that reuse the previous frame still can within a run
+	//Frames of the first pass are kept for the passes after it while they fit in --cache
+	FramePipeline pipeline(*source, first, roi, set_roi, loop, !headless, (size_t)std::max(0, options.cacheMB) << 20);
+	pipeline.SetLatency(latency);
+
+	pipeline.Start(match_stages,
+	//Analyse stage
+	[&](FramePacket& packet) {
+		if (packet.first) {
+			//Each pass over a looping input gets its own results file
+			if (packet.sequence > 0) {
 				output_data.NewFile(root_directory + "/results/raw/sequential/" + std::to_string(std::time(nullptr)) + ".txt");
-				Capture.SetPos(0);
-				Capture >> curr;
-				continue;
+				heart_rate.Reset();
 			}
 
-			break;
+			return;
 		}
 
-		if (set_roi)
-			curr = curr(roi);
+		packet.averages = Util::analyseData(packet.field);
+		output_data.Add(packet.index, packet.averages[0], packet.averages[1], packet.averages[2], packet.averages[3]);
 
-		//Convert frames to grayscale for faster processing. Keep original data for visualisation
-		cv::cvtColor(prev, prevGray, cv::COLOR_BGR2GRAY);
-		cv::cvtColor(curr, currGray, cv::COLOR_BGR2GRAY);
+		if (recorder)
+			recorder->Add(packet.index, packet.field);
 
-		//Create point array to store 
-		cv::Point * motionVectors = new cv::Point[bCount];
-		cv::Point2f * motionDetails = new cv::Point2f[bCount];
+		heart_rate.Add(packet.averages[3]);
+		packet.bpm = heart_rate.GetBPM();
+	}, pairs > 1 ? 8 : 1);
 
-		//Perform Block Matching
-		BlockMatching::FullExhastiveSAD(currGray, prevGray, motionVectors, motionDetails, blockSize, stepSize, width, height, wB, hB);
+	//Whole run timer for the total frame rate reported in headless mode
+	Timer total;
+	long long processed_frames = 0;
+	float bpm = 0;
+	total.tic();
 
-		//Clock timer so FPS isn't inclusive of drawing onto the screen
-		pT.toc();
+	//Render stage, rT measures the rate frames leave the pipeline
+	FramePacket * packet;
+	rT.tic();
+	report.tic();
 
-		cv::Mat display = curr.clone();
+	while (key != 27 && pipeline.Pop(packet)) { //While !Esc and frames remain
+		if (packet->first) {
+			pipeline.Release(packet);
+			continue;
+		}
 
-		//Draw Motion Vectors from mVecBuffer
+		processed_frames++;
+		bpm = packet->bpm;
 
-		cv::Vec4f averages = Util::analyseData(motionVectors, motionDetails, wB * hB);
-		motion_graph.AddData(averages[3]);
+		//Before the headless branch so headless runs report too
+		if (latency && report.getElapsed() > 10 * NANO) {
+			latency->Report(std::cout);
+			report.tic();
+		}
+
+		//Nothing to render
+		if (headless) {
+			pipeline.Release(packet);
+			continue;
+		}
+
+		//Draw latency is up to the frame being shown, not the wait for a key
+		draw.tic();
+		cv::Mat display = packet->colour.clone();
+
+		//Draw Motion Vectors from mVecBuffer
+		motion_graph.AddData(packet->averages[3]);
 		//Draw::Arrow(display, cv::Point(averages[0], averages[1]));
 
 		if(draw_motion_vectors)
-			Draw::MotionVectors(display, motionVectors, wB, hB, blockSize, stepSize);
+			Draw::MotionVectors(display, packet->field);
 
 		if(draw_hsv)
-			Draw::MotionVectorHSVAngles(display, motionVectors, motionDetails, wB, hB, blockSize, stepSize, 127, 0.2);
-
-		output_data.AddLine(std::to_string(averages[3]), std::to_string(averages[2]));
-
-		//Free pointer block
-		free(motionVectors);
-		free(motionDetails);
+			Draw::MotionVectorHSVAngles(display, packet->field, 127, 0.2);
 
-		//Finish render timer
 		rT.toc();
+		rT.tic();
 
 		//Display program information on frame
-		Draw::Text(display, std::to_string(Capture.GetPos()), std::to_string(blockSize),
-			std::to_string(stepSize), std::to_string(pT.getFPSFromElapsed()), std::to_string(rT.getFPSFromElapsed()));
+		Draw::Text(display, std::to_string(packet->index), std::to_string(packet->field.GetBlockSize()),
+			std::to_string(packet->field.GetStepSize()), std::to_string(packet->processed_fps), std::to_string(rT.getFPSFromElapsed()), packet->engine);
+		Draw::BPM(display, packet->bpm);
+
+		pipeline.Release(packet);
 
 		//Display visualisation of motion vectors
 		cv::imshow(winname, display);
 		motion_graph.Show();
 
+		if (latency)
+			(*latency)[StageTimers::Draw]->Record(draw.getElapsed());
+
 		key = (char)cv::waitKey(cvWaitTime);
 
 		switch (key) {
@@ -169,20 +556,16 @@ int main(int argc, char **argv)
 			cvWaitTime = cvWaitTime == 0 ? 1 : 0;
 			break;
 		case '+':
-			bID = bID < bSizes.size() - 1 ? bID + 1 : bID;
-			blockSize = bSizes.at(bID);
-			stepSize = Util::getStepSize(blockSize);
-			wB = (width / blockSize * blockSize / stepSize) - 1;
-			hB = (height / blockSize * blockSize / stepSize) - 1;
-			bCount = wB * hB;
-			break;
 		case '-':
-			bID = bID > 0 ? bID - 1 : 0;
-			blockSize = bSizes.at(bID);
-			stepSize = Util::getStepSize(blockSize);
-			wB = (width / blockSize * blockSize / stepSize) - 1;
-			hB = (height / blockSize * blockSize / stepSize) - 1;
-			bCount = wB * hB;
+		case 't':
+			controls.TryPush(key);
+			break;
+		case 'm':
+		case 's':
+		case 'l':
+		case 'e':
+			controls.TryPush(key);
+			motion_graph.Reset();
 			break;
 		case 'd':
 			draw_motion_vectors = !draw_motion_vectors;
@@ -193,7 +576,20 @@ int main(int argc, char **argv)
 		default:
 			break;
 		}
-	} while (key != 27); //Do while !Esc
+	}
+
+	//Stage threads are joined before their state (e.g. output_data) is used here
+	pipeline.Stop();
+
+	if (latency)
+		latency->Report(std::cout);
+
+	if (headless) {
+		float seconds = total.getElapsed() / NANO;
+		output_data.Close();
+		std::cout << "Processed " << processed_frames << " frames in " << seconds << "s, " << (seconds > 0 ? processed_frames / seconds : 0) << " frames/s, " << bpm << " BPM" << std::endl;
+		return 0;
+	}
 
 	cv::destroyAllWindows();
 	return 0;
@@ -0,0 +1,254 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <map>
+#include <set>
+
+#include <opencv2/opencv.hpp>
+
+#include "Capture.hpp"
+#include "FrameStack.hpp"
+#include "DecodeBudget.hpp"
+
+#ifdef USE_DCMTK
+#include "Dicom.hpp"
+#endif
+
+//Input file of a batch and the number of frames it holds, an estimate for videos so it is only used to order the work
+struct Study {
+	std::string path, name;
+	int frame_count = 0;
+
+	//Names the results file of the study, unique within its batch. The file name unless set
+	std::string GetName() const {
+		return this->name.empty() ? this->GetFileName() : this->name;
+	};
+
+	//File name without directories or extension
+	std::string GetFileName() const {
+		size_t start = this->path.find_last_of("/\\");
+		start = start == std::string::npos ? 0 : start + 1;
+
+		size_t end = this->path.find_last_of('.');
+		end = end == std::string::npos || end < start ? this->path.size() : end;
+
+		return this->path.substr(start, end - start);
+	};
+
+	bool IsDicom() const {
+		return HasExtension(this->path, ".dcm");
+	};
+
+	bool IsFrameStack() const {
+		return HasExtension(this->path, ".stack");
+	};
+
+	static bool HasExtension(const std::string& path, const std::string& extension) {
+		if (path.size() < extension.size())
+			return false;
+
+		std::string end = path.substr(path.size() - extension.size());
+		std::transform(end.begin(), end.end(), end.begin(), ::tolower);
+		return end == extension;
+	};
+};
+
+//Runs every study of a directory or manifest on a fixed set of worker threads. Studies are started longest first by
+//frame count so the longest one isn't left running on its own at the end. The DICOM studies open at once decode ahead
+//of their workers out of one budget of frames, which bounds the memory of decoded frames separately from the number of
+//workers matching.
+class BatchScheduler {
+public:
+	typedef std::function<void(const Study&)> Process;
+
+	//decoders is the number of frames decoded ahead across every study, 4 per worker unless set
+	BatchScheduler(int workers = 0, int decoders = 0) {
+		this->workers = workers > 0 ? workers : std::max(1u, std::thread::hardware_concurrency());
+		this->budget.reset(new DecodeBudget(decoders > 0 ? decoders : 4 * this->workers));
+	};
+
+	//A directory is searched for videos and frame stacks (and DICOM files when built with DCMTK), a .txt or .lst file is read as a manifest
+	//with one path per line where empty lines and lines starting with # are skipped
+	bool AddStudies(const std::string& path) {
+		std::vector<std::string> paths;
+
+		if (Study::HasExtension(path, ".txt") || Study::HasExtension(path, ".lst")) {
+			std::ifstream manifest(path);
+
+			if (!manifest.good()) {
+				std::cerr << "Could not open manifest: " << path << std::endl;
+				return false;
+			}
+
+			std::string line;
+			while (std::getline(manifest, line)) {
+				//Trim Windows line endings and surrounding whitespace
+				line.erase(line.find_last_not_of(" \t\r\n") + 1);
+				line.erase(0, line.find_first_not_of(" \t"));
+
+				if (!line.empty() && line[0] != '#')
+					paths.push_back(line);
+			}
+		}
+		else {
+			std::vector<cv::String> files;
+			cv::glob(path, files, false);
+
+			for (size_t i = 0; i < files.size(); i++)
+				if (IsSupported(files[i]))
+					paths.push_back(files[i]);
+		}
+
+		for (size_t i = 0; i < paths.size(); i++) {
+			Study study;
+			study.path = paths[i];
+			study.frame_count = CountFrames(study);
+
+			if (study.frame_count < 2) {
+				std::cerr << "Skipping " << study.path << ", it could not be opened or has fewer than two frames" << std::endl;
+				continue;
+			}
+
+			this->studies.push_back(study);
+		}
+
+		this->NameStudies();
+		return !this->studies.empty();
+	};
+
+	//Blocks until every study has been processed, returns the number that failed (threw)
+	int Run(const Process& process) {
+		std::stable_sort(this->studies.begin(), this->studies.end(), [](const Study& a, const Study& b) {
+			return a.frame_count > b.frame_count;
+		});
+
+		this->next = 0;
+		this->failed = 0;
+
+		std::vector<std::thread> threads;
+		for (int i = 0; i < std::min(this->workers, (int)this->studies.size()); i++)
+			threads.emplace_back(&BatchScheduler::Worker, this, std::cref(process));
+
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+
+		return this->failed;
+	};
+
+	const std::vector<Study>& GetStudies() const {
+		return this->studies;
+	};
+
+	int GetWorkerCount() const {
+		return this->workers;
+	};
+
+	//For the sources of the studies, see FrameSource::Open
+	DecodeBudget * GetDecodeBudget() {
+		return this->budget.get();
+	};
+
+	static bool IsSupported(const std::string& path) {
+#ifdef USE_DCMTK
+		if (Study::HasExtension(path, ".dcm"))
+			return true;
+#endif
+		return Study::HasExtension(path, ".stack") || Study::HasExtension(path, ".avi") || Study::HasExtension(path, ".mp4") || Study::HasExtension(path, ".mov");
+	};
+
+	//Only what the ordering needs: a DICOM's header, not its pixel data, as the worker loads the study again
+	static int CountFrames(const Study& study) {
+#ifdef USE_DCMTK
+		if (study.IsDicom())
+			return Dicom::ReadFrameCount(study.path);
+#endif
+		if (study.IsFrameStack())
+			return FrameStack(study.path).GetFrameCount();
+
+		return Capture(study.path).GetFrameCount();
+	};
+private:
+	std::vector<Study> studies;
+	int workers;
+	std::unique_ptr<DecodeBudget> budget;
+	std::atomic<int> next{ 0 }, failed{ 0 };
+
+	//Studies sharing a file name (IM_0001.dcm of several patient folders) are named by their path below the directory
+	//they have in common instead, and numbered if that is the same too, so no two write the same results file
+	void NameStudies() {
+		std::map<std::string, std::vector<size_t>> names;
+
+		for (size_t i = 0; i < this->studies.size(); i++) {
+			this->studies[i].name = this->studies[i].GetFileName();
+			names[this->studies[i].name].push_back(i);
+		}
+
+		for (auto it = names.begin(); it != names.end(); it++) {
+			const std::vector<size_t>& same = it->second;
+			if (same.size() < 2)
+				continue;
+
+			std::string common = this->studies[same[0]].path;
+			for (size_t i = 1; i < same.size(); i++) {
+				const std::string& path = this->studies[same[i]].path;
+				size_t length = 0;
+
+				while (length < common.size() && length < path.size() && common[length] == path[length])
+					length++;
+
+				common.resize(length);
+			}
+
+			size_t directory = common.find_last_of("/\\");
+			common.resize(directory == std::string::npos ? 0 : directory + 1);
+
+			for (size_t i = 0; i < same.size(); i++) {
+				Study& study = this->studies[same[i]];
+				std::string relative = study.path.substr(common.size());
+
+				size_t end = relative.find_last_of('.'), slash = relative.find_last_of("/\\");
+				if (end != std::string::npos && (slash == std::string::npos || end > slash))
+					relative.resize(end);
+
+				std::replace(relative.begin(), relative.end(), '/', '_');
+				std::replace(relative.begin(), relative.end(), '\\', '_');
+				study.name = relative;
+			}
+		}
+
+		std::set<std::string> used;
+		for (size_t i = 0; i < this->studies.size(); i++) {
+			std::string name = this->studies[i].name;
+
+			for (int n = 2; used.count(name); n++)
+				name = this->studies[i].name + "_" + std::to_string(n);
+
+			this->studies[i].name = name;
+			used.insert(name);
+		}
+	};
+
+	void Worker(const Process& process) {
+		for (int i = this->next++; i < (int)this->studies.size(); i = this->next++) {
+			try {
+				process(this->studies[i]);
+			}
+			catch (const std::exception& err) {
+				std::cerr << "Failed " << this->studies[i].path << ": " << err.what() << std::endl;
+				this->failed++;
+			}
+			catch (...) {
+				std::cerr << "Failed " << this->studies[i].path << std::endl;
+				this->failed++;
+			}
+		}
+	};
+};
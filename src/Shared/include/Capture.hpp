@@ -1,3 +1,4 @@
+#pragma once
 #include <string>
 
 #include <opencv2/opencv.hpp>
@@ -21,7 +22,7 @@ public:
 	};
 
 	void Reset() {
-		this->vc.set(cv::CAP_PROP_POS_AVI_RATIO, 0);
+		this->vc.set(cv::CAP_PROP_POS_FRAMES, 0);
 		this->frame_index = 0;
 	};
 
@@ -31,8 +32,9 @@ public:
 
 	int GetHeight() { return this->height; };
 
+	//Index of the next frame to read, POS_AVI_RATIO is a fraction of the file so only ever worked for 0
 	void SetPos(int index = 0) { 
-		this->vc.set(cv::CAP_PROP_POS_AVI_RATIO, index); 
+		this->vc.set(cv::CAP_PROP_POS_FRAMES, index); 
 		this->frame_index = index; 
 	};
 
@@ -42,6 +44,11 @@ public:
 		return this->frame_count;
 	};
 
+	//Frames per second stored in the container, 0 if unknown
+	double GetFrameRate() {
+		return this->vc.get(cv::CAP_PROP_FPS);
+	};
+
 	bool isLastFrame() {
 		return this->frame_count - 1 == this->frame_index;
 	}
@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+//Number of frames that may be decoded ahead of their readers at once, shared by every source of a process (e.g. the
+//studies of a batch) so the memory taken by decoded frames is bounded however many sources are open. A frame takes a
+//unit before it is decoded and gives it back once its reader takes it. Decoders wait for a unit rather than the studies
+//for a worker, so matching never waits on the budget while its own frames are decoded.
+class DecodeBudget {
+public:
+	DecodeBudget(int frames = 1) {
+		this->free = std::max(1, frames);
+	};
+
+	DecodeBudget(const DecodeBudget&) = delete;
+	DecodeBudget& operator=(const DecodeBudget&) = delete;
+
+	//Waits for a unit, false without one once stop returns true. stop is checked under the budget's lock, so whoever
+	//makes it true calls Wake() after
+	bool Acquire(const std::function<bool()>& stop) {
+		std::unique_lock<std::mutex> lock(this->lock);
+		this->available.wait(lock, [&] { return this->free > 0 || stop(); });
+
+		if (this->free == 0)
+			return false;
+
+		this->free--;
+		return true;
+	};
+
+	void Release(int frames = 1) {
+		if (frames <= 0)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(this->lock);
+			this->free += frames;
+		}
+
+		this->available.notify_all();
+	};
+
+	void Wake() {
+		{
+			std::lock_guard<std::mutex> lock(this->lock);
+		}
+
+		this->available.notify_all();
+	};
+private:
+	int free;
+	std::mutex lock;
+	std::condition_variable available;
+};
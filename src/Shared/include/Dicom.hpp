@@ -3,6 +3,8 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <mutex>
+#include <algorithm>
 
 #include "dcmtk/config/osconfig.h"
 #include "dcmtk/dcmdata/dctk.h"
@@ -11,19 +13,44 @@
 #include "dcmtk/dcmjpeg/djencode.h"
 #include "dcmtk/dcmjpeg/djdecode.h" 
 #include "dcmtk/dcmdata/dcxfer.h"
+#include "dcmtk/dcmdata/dcpixseq.h"
+#include "dcmtk/dcmdata/dcpxitem.h"
+#include "dcmtk/dcmdata/dccodec.h"
 
 class Dicom {
 public:
 	Dicom(std::string filePath, bool compressed = true) {
-		//Register codecs for dcmtk until class is destroyed
-		DJDecoderRegistration::registerCodecs();
+		//Register codecs for dcmtk until the last Dicom is destroyed
+		RegisterCodecs();
 		this->path = filePath;
 		this->compressed = compressed;
-		this->Load();
+		this->loaded = this->Load();
 	};
 
 	~Dicom() {
-		DJDecoderRegistration::cleanup();
+		ReleaseCodecs();
+	};
+
+	//DCMTK's codecs are registered for the whole process and aren't thread safe, so they are registered while any Dicom
+	//exists and every Dicom decodes under one lock. Recursive as the frame functions lock it around their own decoding
+	static std::recursive_mutex& DecodeLock() {
+		static std::recursive_mutex lock;
+		return lock;
+	};
+
+	//NumberOfFrames of a file without loading its pixel data, elements longer than a few KB are left on disk. 0 when the
+	//file can't be read or has no such tag
+	static int ReadFrameCount(const std::string& filePath) {
+		DcmFileFormat header;
+		long int count = 0;
+
+		if (header.loadFile(filePath.c_str(), EXS_Unknown, EGL_noChange, 4096).bad())
+			return 0;
+
+		if (header.getDataset()->findAndGetLongInt(DCM_NumberOfFrames, count).bad())
+			return 0;
+
+		return (int)count;
 	};
 
 	//Functions that will eventually allow eassier use of this class
@@ -38,6 +65,8 @@ public:
 
 	//Functions that will eventually allow eassier use of this class
 	bool GetFrame(cv::Mat& in, int index) {
+		std::lock_guard<std::recursive_mutex> lock(DecodeLock());
+
 		if (this->compressed) {
 			return GetCompressedFrame(in, index);
 		}
@@ -58,10 +87,14 @@ public:
 
 	//TODO: Fully Implement Compressed/Decompressed Files for speed (3x faster)
 	bool LoadDecompressedFile() {
+		std::lock_guard<std::recursive_mutex> lock(DecodeLock());
 		this->frames = new DicomImage(this->path.c_str(), EXS_LittleEndianExplicit);
 		this->width = (long int)this->frames->getWidth();
 		this->height = (long int)this->frames->getHeight();
-		this->bits_allocated = (long int)this->frames->getDepth();
+		//Frames are rendered to the full range of 8 or 16 bits
+		this->bits_allocated = this->frames->getDepth() > 8 ? 16 : 8;
+		this->bits_stored = this->bits_allocated;
+		this->samples_per_pixel = this->frames->isMonochrome() ? 1 : 3;
 		this->frame_bytes = (Uint32)this->frames->getOutputDataSize();
 		this->frame_count = (long int)this->frames->getFrameCount();
 
@@ -104,14 +137,23 @@ public:
 			if (EC_Normal != dataset->findAndGetLongInt(DCM_BitsAllocated, this->bits_allocated))
 				throw std::runtime_error("Could not get BitsAllocated tag from: " + this->path);
 
+			if (EC_Normal != dataset->findAndGetLongInt(DCM_BitsStored, this->bits_stored))
+				this->bits_stored = this->bits_allocated;
+
 			if (EC_Normal != dataset->findAndGetLongInt(DCM_NumberOfFrames, this->frame_count))
 				throw std::runtime_error("Could not get NumberOfFrames tag from: " + this->path);
 
 			if (EC_Normal != dataset->findAndGetElement(DCM_PixelData, this->pixel_data))
 				throw std::runtime_error("Could not get pixel data from: " + this->path);
 
+			//Milliseconds between frames, optional as not every multi-frame module has it
+			if (EC_Normal != dataset->findAndGetFloat64(DCM_FrameTime, this->frame_time))
+				this->frame_time = 0;
+
 			//Get number of bytes contained for each frame
 			this->pixel_data->getUncompressedFrameSize(dataset, frame_bytes);
+
+			this->BuildFragmentTable();
 			return true;
 		}
 		catch (std::exception err) {
@@ -169,61 +211,45 @@ public:
 		return xferUID;
 	};
 
-	//Return uncompressed data from DICOM file without decompressing entire dataset in memory
+	//Return uncompressed data from DICOM file without decompressing entire dataset in memory. Single channel frames are
+	//decoded straight into in, colour ones into a reused buffer and converted to BGR on the way out
 	bool GetCompressedFrame(cv::Mat& in, int index) {
-		//Attempt to handle multple bit allocations
 		try {
-			if (index < 0 || index > this->frame_count - 1)
-				throw std::runtime_error("Invalid index for DICOM file in GetFrame: " + std::to_string(index));
-
-			//Calculate frame position
-			Uint32 frame_offset = (Uint32)index;
-
-			//Store status for both 8 and 16 bit files
-			//Only support 8|16
-			OFCondition status;
-
-			//Create empty matic incase any errors are thrown
-			cv::Mat result(this->height, this->width, CV_MAKETYPE(this->bits_allocated, this->samples_per_pixel));
-
-			if (this->bits_allocated == 8) {
-				//Allocate buffer memory
-				Uint8 * buffer = new Uint8[int(this->frame_bytes)];
-				status = UncompressFrame(buffer, frame_offset);
-				//Create matrix and later clone it so that buffer memory doesn't leak
-				//TODO: Don't clone the matrix, only have one reference to the created matrix
-				result = cv::Mat(this->height, this->width, CV_MAKETYPE(this->bits_allocated, this->samples_per_pixel), (long *)buffer);
-				//Clone result matrix for now until buffer issue is resolved
-				in = result.clone();
-				//Deallocate buffer memory
-				free(buffer);
-			}
-			else if (this->bits_allocated == 16) {
-				Uint16 * buffer = new Uint16[int(this->frame_bytes)];
-				status = UncompressFrame(buffer, frame_offset);
-				result = cv::Mat(this->height, this->width, CV_MAKETYPE(this->bits_allocated, this->samples_per_pixel), (long *)buffer);
-				in = result.clone();
-				free(buffer);
+			if (this->samples_per_pixel == 1) {
+				this->DecodeFrame(in, index);
 			}
 			else {
-				throw std::runtime_error("DICOM file has an unsupported number of bits allocated: " + std::to_string(this->bits_allocated));
+				this->DecodeFrame(this->frame_buffer, index);
+				cv::cvtColor(this->frame_buffer, in, this->samples_per_pixel == 4 ? cv::COLOR_RGBA2BGRA : cv::COLOR_RGB2BGR);
 			}
+		}
+		catch (std::exception err) {
+			//TODO: Stop program execution
+			std::cerr << err.what() << std::endl;
+			return false;
+		}
 
-			if (status.bad())
-				throw std::runtime_error("Couldn't uncompress frame from: " + this->path + " for frame " + std::to_string(index));
+		return true;
+	};
 
-			this->frame_index = index;
+	//8 bit gray plane of a frame, which is all the matching needs. 8 bit single channel frames are decoded straight into
+	//gray, anything else through a reused buffer and one conversion, so no colour copy is made
+	bool GetGrayFrame(cv::Mat& gray, int index) {
+		std::lock_guard<std::recursive_mutex> lock(DecodeLock());
 
-			//Convert RGB to BGR by swapping the channels
-			if (this->samples_per_pixel == 3) {
-				std::vector<cv::Mat> channels_bgr;
-				cv::split(in, channels_bgr);
-				std::vector<cv::Mat> channels_rgb = { channels_bgr[2], channels_bgr[1], channels_bgr[0] };
-				cv::merge(channels_rgb, in);
+		try {
+			if (!this->compressed) {
+				this->ToGray(this->GetDecompressedData(index), gray);
+			}
+			else if (this->samples_per_pixel == 1 && this->bits_allocated == 8) {
+				this->DecodeFrame(gray, index);
+			}
+			else {
+				this->DecodeFrame(this->frame_buffer, index);
+				this->ToGray(this->frame_buffer, gray);
 			}
 		}
 		catch (std::exception err) {
-			//TODO: Stop program execution
 			std::cerr << err.what() << std::endl;
 			return false;
 		}
@@ -231,42 +257,189 @@ public:
 		return true;
 	};
 
+	//Decodes a frame in the colour model DCMTK gives (RGB) into out, reusing its memory when it already has the size and type
+	void DecodeFrame(cv::Mat& out, int index) {
+		if (index < 0 || index > this->frame_count - 1)
+			throw std::runtime_error("Invalid index for DICOM file in GetFrame: " + std::to_string(index));
+
+		out.create(this->height, this->width, this->GetType());
+
+		if (UncompressFrame(out.data, (Uint32)index).bad())
+			throw std::runtime_error("Couldn't uncompress frame from: " + this->path + " for frame " + std::to_string(index));
+
+		this->frame_index = index;
+	};
+
+	//16 bit frames go through a table of the stored bits to 8 bit, colour ones are reduced to luminance
+	void ToGray(const cv::Mat& in, cv::Mat& gray) {
+		const cv::Mat * eight_bit = &in;
+
+		if (in.depth() == CV_16U) {
+			const std::vector<uchar>& lut = this->GetLUT();
+			cv::Mat& out = in.channels() == 1 ? gray : this->lut_buffer;
+			out.create(in.rows, in.cols, CV_MAKETYPE(CV_8U, in.channels()));
+
+			for (int y = 0; y < in.rows; y++) {
+				const Uint16 * src = in.ptr<Uint16>(y);
+				uchar * dst = out.ptr<uchar>(y);
+
+				for (int x = 0; x < in.cols * in.channels(); x++)
+					dst[x] = lut[src[x]];
+			}
+
+			if (in.channels() == 1)
+				return;
+
+			eight_bit = &this->lut_buffer;
+		}
+
+		if (eight_bit->channels() == 3)
+			cv::cvtColor(*eight_bit, gray, cv::COLOR_RGB2GRAY);
+		else if (eight_bit->channels() == 4)
+			cv::cvtColor(*eight_bit, gray, cv::COLOR_RGBA2GRAY);
+		else
+			eight_bit->copyTo(gray);
+	};
+
+	//Maps every 16 bit value to its top 8 stored bits, built on first use
+	const std::vector<uchar>& GetLUT() {
+		if (this->lut.empty()) {
+			int shift = std::max(0, (int)this->bits_stored - 8);
+			this->lut.resize(65536);
+
+			for (int i = 0; i < 65536; i++)
+				this->lut[i] = (uchar)std::min(255, i >> shift);
+		}
+
+		return this->lut;
+	};
+
+	int GetType() {
+		if (this->bits_allocated != 8 && this->bits_allocated != 16)
+			throw std::runtime_error("DICOM file has an unsupported number of bits allocated: " + std::to_string(this->bits_allocated));
+
+		return CV_MAKETYPE(this->bits_allocated == 16 ? CV_16U : CV_8U, (int)this->samples_per_pixel);
+	};
+
 	template<typename T>
-	OFCondition UncompressFrame(T& buffer, Uint32 frame_offset) {
+	OFCondition UncompressFrame(T buffer, Uint32 frame_offset) {
 		//Get uncompressed representation of frame without storing whole dicom file in memory
 		//Takes longer but is more memory efficiant
+		std::lock_guard<std::recursive_mutex> decode_lock(DecodeLock());
+		std::lock_guard<std::mutex> lock(this->data_lock);
 		return this->pixel_data->getUncompressedFrame(this->dataset, frame_offset,
-			StartFragment(), buffer, this->frame_bytes, this->decompressed_color_model, this->cache);
+			StartFragment(frame_offset), buffer, this->frame_bytes, this->decompressed_color_model, this->cache);
 	};
 
-	//For getting uncompressed frames, resets position to get next frames from
-	//TODO: research better methods
-	Uint32& StartFragment() {
-		this->start_fragment = 0;
+	//First fragment of a frame from the table built at load, 0 (DCMTK scans every fragment before the frame) without one
+	Uint32& StartFragment(Uint32 frame) {
+		this->start_fragment = frame < this->frame_fragments.size() ? this->frame_fragments[frame] : 0;
 		return this->start_fragment;
 	};
 
+	//Index into the pixel sequence of the first fragment of every frame, so a frame is found without DCMTK walking the
+	//fragments of the frames before it. Taken from the Basic Offset Table, or one frame per fragment, through DCMTK and
+	//otherwise from the fragments starting with a JPEG SOI marker. Left empty when neither gives one entry per frame.
+	void BuildFragmentTable() {
+		this->fragments.clear();
+		this->frame_fragments.clear();
+
+		DcmPixelSequence * sequence = this->GetPixelSequence();
+		if (sequence == NULL)
+			return;
+
+		//Item 0 is the offset table, fragments follow
+		for (unsigned long i = 0; i < sequence->card(); i++) {
+			DcmPixelItem * item = NULL;
+			if (sequence->getItem(item, i).bad())
+				return;
+			this->fragments.push_back(item);
+		}
+
+		for (Uint32 frame = 0; frame < (Uint32)this->frame_count; frame++) {
+			Uint32 fragment = 0;
+			if (DcmCodec::determineStartFragment(frame, (Sint32)this->frame_count, sequence, fragment).bad()) {
+				this->frame_fragments.clear();
+				break;
+			}
+			this->frame_fragments.push_back(fragment);
+		}
+
+		if (this->frame_fragments.empty() && this->IsJPEG()) {
+			for (size_t i = 1; i < this->fragments.size(); i++) {
+				Uint8 * data = NULL;
+				if (this->fragments[i]->getLength() >= 2 && this->fragments[i]->getUint8Array(data).good() && data[0] == 0xFF && data[1] == 0xD8)
+					this->frame_fragments.push_back((Uint32)i);
+			}
+
+			if ((long int)this->frame_fragments.size() != this->frame_count)
+				this->frame_fragments.clear();
+		}
+	};
+
+	//Encapsulated pixel data in the transfer syntax of the file, NULL when it is not compressed
+	DcmPixelSequence * GetPixelSequence() {
+		E_TransferSyntax xfer = this->dataset->getOriginalXfer();
+		DcmPixelSequence * sequence = NULL;
+
+		if (!DcmXfer(xfer).isEncapsulated())
+			return NULL;
+
+		if (OFstatic_cast(DcmPixelData *, this->pixel_data)->getEncapsulatedRepresentation(xfer, NULL, sequence).bad())
+			return NULL;
+
+		return sequence;
+	};
+
+	bool IsJPEG() {
+		return DcmXfer(this->dataset->getOriginalXfer()).isEncapsulated() && this->dataset->getOriginalXfer() >= EXS_JPEGProcess1
+			&& this->dataset->getOriginalXfer() <= EXS_JPEGProcess14SV1;
+	};
+
+	//8 bit baseline and extended JPEG, which a JPEG decoder other than DCMTK's can read from the frame data. Extended
+	//(process 4) frames may also have 12 bit samples, those are left to DCMTK
+	bool IsBaselineJPEG() {
+		E_TransferSyntax xfer = this->dataset->getOriginalXfer();
+		return (xfer == EXS_JPEGProcess1 || xfer == EXS_JPEGProcess2_4) && this->bits_allocated == 8 && this->bits_stored <= 8;
+	};
+
+	bool HasFragmentTable() {
+		return (long int)this->frame_fragments.size() == this->frame_count;
+	};
+
+	//Compressed bitstream of a frame, its fragments joined. Safe to call from several threads as DCMTK may read the
+	//fragments from the file on first use
+	bool GetFrameData(int index, std::vector<uchar>& data) {
+		if (!this->HasFragmentTable() || index < 0 || index > this->frame_count - 1)
+			return false;
+
+		size_t first = this->frame_fragments[index];
+		size_t last = index + 1 < this->frame_count ? this->frame_fragments[index + 1] : this->fragments.size();
+
+		std::lock_guard<std::mutex> lock(this->data_lock);
+		data.clear();
+
+		for (size_t i = first; i < last; i++) {
+			Uint8 * bytes = NULL;
+			if (this->fragments[i]->getUint8Array(bytes).bad())
+				return false;
+			data.insert(data.end(), bytes, bytes + this->fragments[i]->getLength());
+		}
+
+		return true;
+	};
+
 	//TODO: Fix to work cross platform
 	bool GetDecompressedFrame(cv::Mat& in, int index) {
 
 		try {
-			if (index < 0 || index > this->frame_count - 1)
-				throw std::runtime_error("Invalid index for DICOM file in GetFrame: " + std::to_string(index));
-
-			//Get pixel data from dicom image at location
-			Uint8 *pixel_data = (Uint8 *)this->frames->getOutputData(this->bits_allocated, index);
-			cv::Mat result(this->height, this->width, CV_MAKETYPE(this->bits_allocated, this->samples_per_pixel), (long *)pixel_data);
-
-			in = result.clone();
-			this->frame_index = index;
-
-			//Convert RGB to BGR
-			if (this->samples_per_pixel == 3) {
-				std::vector<cv::Mat> channels_bgr;
-				cv::split(in, channels_bgr);
-				std::vector<cv::Mat> channels_rgb = { channels_bgr[2], channels_bgr[1], channels_bgr[0] };
-				cv::merge(channels_rgb, in);
-			}
+			cv::Mat result = this->GetDecompressedData(index);
+
+			//Convert RGB to BGR, which copies out of the DicomImage like the clone does for gray frames
+			if (this->samples_per_pixel == 3)
+				cv::cvtColor(result, in, cv::COLOR_RGB2BGR);
+			else
+				result.copyTo(in);
 		}
 		catch (std::exception err) {
 			std::cerr << err.what() << std::endl;
@@ -276,6 +449,25 @@ public:
 		return true;
 	};
 
+	//Frame owned by the DicomImage, valid until the next call
+	cv::Mat GetDecompressedData(int index) {
+		if (index < 0 || index > this->frame_count - 1)
+			throw std::runtime_error("Invalid index for DICOM file in GetFrame: " + std::to_string(index));
+
+		//Get pixel data from dicom image at location
+		void * pixel_data = (void *)this->frames->getOutputData(this->bits_allocated, index);
+		if (pixel_data == NULL)
+			throw std::runtime_error("Couldn't render frame from: " + this->path + " for frame " + std::to_string(index));
+
+		this->frame_index = index;
+		return cv::Mat(this->height, this->width, this->GetType(), pixel_data);
+	};
+
+	//False when the file couldn't be read, nothing but this may be called then
+	bool IsLoaded() {
+		return this->loaded;
+	};
+
 	int GetWidth() {
 		return this->width;
 	};
@@ -296,6 +488,15 @@ public:
 		return this->frame_count;
 	};
 
+	double GetFrameTime() {
+		return this->frame_time;
+	};
+
+	//Frames per second from FrameTime, 0 if the file has none
+	double GetFrameRate() {
+		return this->frame_time > 0 ? 1000.0 / this->frame_time : 0;
+	};
+
 	void SetPos(int index = 0) {
 		this->frame_index = index;
 	}
@@ -306,14 +507,44 @@ public:
 private:
 	std::string path;
 	int frame_index = 0;
-	bool compressed;
-	long int width, height, samples_per_pixel = 3, bits_allocated, frame_count;
+	bool compressed, loaded = false;
+	long int width, height, samples_per_pixel = 3, bits_allocated, bits_stored = 8, frame_count = 0;
 	Uint32 start_fragment = 0, frame_bytes = 0;
+	Float64 frame_time = 0;
 	E_TransferSyntax rep_type;
 	DcmFileFormat file_format;
-	DcmDataset *dataset;
+	DcmDataset *dataset = NULL;
 	DcmElement * pixel_data = NULL;
 	OFString decompressed_color_model = NULL;
 	DcmFileCache *cache = NULL;
-	DicomImage * frames;
+	DicomImage * frames = NULL;
+	cv::Mat frame_buffer, lut_buffer;
+	std::vector<uchar> lut;
+	std::vector<DcmPixelItem *> fragments;
+	std::vector<Uint32> frame_fragments;
+	std::mutex data_lock;
+
+	static std::mutex& CodecLock() {
+		static std::mutex lock;
+		return lock;
+	};
+
+	static int& CodecUsers() {
+		static int users = 0;
+		return users;
+	};
+
+	static void RegisterCodecs() {
+		std::lock_guard<std::mutex> lock(CodecLock());
+
+		if (CodecUsers()++ == 0)
+			DJDecoderRegistration::registerCodecs();
+	};
+
+	static void ReleaseCodecs() {
+		std::lock_guard<std::mutex> lock(CodecLock());
+
+		if (--CodecUsers() == 0)
+			DJDecoderRegistration::cleanup();
+	};
 };
\ No newline at end of file
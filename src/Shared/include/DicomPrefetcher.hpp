@@ -0,0 +1,188 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <opencv2/opencv.hpp>
+
+#include "Dicom.hpp"
+#include "DecodeBudget.hpp"
+
+//Reads the frames of a compressed DICOM in order while a few threads decode the frames after it, at most window frames
+//ahead of the reader so memory stays bounded on long studies. Baseline JPEG frames are taken from the fragment table of
+//the Dicom and decoded by OpenCV on any thread, other transfer syntaxes (or a file without a table) go through DCMTK,
+//which decodes one frame at a time across every Dicom of the process as its codecs aren't thread safe. With gray set
+//only the 8 bit gray plane is decoded, for readers that don't display the frames. Frames are decoded into the buffers
+//of the window, which the reader hands back with every read, so decoding doesn't allocate once the window is full. With
+//a budget every frame decoded ahead also takes a unit of it, which bounds the frames held across many prefetchers.
+class DicomPrefetcher {
+public:
+	//Reading starts at frame start, the budget must outlive the prefetcher
+	DicomPrefetcher(Dicom& dicom, int threads = 2, int window = 8, bool gray = false, int start = 0, DecodeBudget * budget = NULL) : dicom(dicom) {
+		this->budget = budget;
+		this->frame_count = dicom.GetFrameCount();
+		this->window = std::max(1, window);
+		this->gray = gray;
+		this->frame_index = this->next = std::max(0, std::min(start, this->frame_count));
+		this->slots.resize(this->window);
+		this->parallel = dicom.IsBaselineJPEG() && dicom.HasFragmentTable();
+
+		threads = this->parallel ? std::max(1, threads) : 1;
+		for (int i = 0; i < threads; i++)
+			this->workers.emplace_back(&DicomPrefetcher::Worker, this);
+	};
+
+	~DicomPrefetcher() {
+		{
+			std::lock_guard<std::mutex> lock(this->slot_lock);
+			this->stopped = true;
+		}
+
+		this->ready.notify_all();
+		if (this->budget)
+			this->budget->Wake();
+
+		for (size_t i = 0; i < this->workers.size(); i++)
+			this->workers[i].join();
+
+		//Every frame a worker took a unit for is in the window once it has been joined
+		if (this->budget) {
+			int unread = 0;
+			for (size_t i = 0; i < this->slots.size(); i++)
+				unread += this->slots[i].index >= 0;
+
+			this->budget->Release(unread);
+		}
+	};
+
+	//Next frame in order, empty after the last one like a Capture at the end of a video. The old buffer of in takes the
+	//place of the frame in the window, to be decoded into again unless the reader still shares it
+	cv::Mat& operator>> (cv::Mat& in) {
+		if (this->frame_index >= this->frame_count) {
+			in.release();
+			return in;
+		}
+
+		Slot& slot = this->slots[this->frame_index % this->window];
+
+		{
+			std::unique_lock<std::mutex> lock(this->slot_lock);
+			this->ready.wait(lock, [&] { return slot.index == this->frame_index; });
+			std::swap(in, slot.frame);
+			slot.index = -1;
+			this->frame_index++;
+		}
+
+		this->ready.notify_all();
+		if (this->budget)
+			this->budget->Release();
+
+		return in;
+	};
+
+	int GetFrameCount() {
+		return this->frame_count;
+	};
+
+	double GetFrameRate() {
+		return this->dicom.GetFrameRate();
+	};
+
+	int GetPos() {
+		return this->frame_index;
+	};
+private:
+	struct Slot {
+		int index = -1;
+		cv::Mat frame;
+	};
+
+	Dicom& dicom;
+	DecodeBudget * budget;
+	std::vector<Slot> slots;
+	std::vector<std::thread> workers;
+	std::mutex slot_lock;
+	std::condition_variable ready;
+	int frame_count, window, frame_index = 0, next = 0;
+	bool parallel, gray;
+	std::atomic<bool> stopped{ false };
+
+	void Worker() {
+		std::vector<uchar> data;
+
+		while (true) {
+			int index;
+			cv::Mat frame;
+
+			{
+				std::unique_lock<std::mutex> lock(this->slot_lock);
+				if (!this->Claim(lock, index))
+					return;
+
+				//The slot was read, its buffer is taken to decode into
+				std::swap(frame, this->slots[index % this->window].frame);
+			}
+
+			this->Decode(index, frame, data);
+
+			{
+				std::lock_guard<std::mutex> lock(this->slot_lock);
+				std::swap(this->slots[index % this->window].frame, frame);
+				this->slots[index % this->window].index = index;
+			}
+
+			this->ready.notify_all();
+		}
+	};
+
+	//Waits for a frame with room in the window and, with a budget, a unit for it. The unit is taken without the slot lock
+	//held, so another worker may have claimed the room meanwhile and the unit is given back to wait again
+	bool Claim(std::unique_lock<std::mutex>& lock, int& index) {
+		while (true) {
+			this->ready.wait(lock, [&] { return this->stopped || this->next >= this->frame_count || this->next < this->frame_index + this->window; });
+
+			if (this->stopped || this->next >= this->frame_count)
+				return false;
+
+			if (!this->budget) {
+				index = this->next++;
+				return true;
+			}
+
+			lock.unlock();
+			bool acquired = this->budget->Acquire([this] { return this->stopped.load(); });
+			lock.lock();
+
+			if (!acquired)
+				return false;
+
+			if (!this->stopped && this->next < this->frame_count && this->next < this->frame_index + this->window) {
+				index = this->next++;
+				return true;
+			}
+
+			this->budget->Release();
+		}
+	};
+
+	//A frame that fails to decode is left empty, which ends the study for the reader. Decodes into the memory of frame
+	//when it has the size and type, a buffer the reader still holds a reference to is left to it
+	void Decode(int index, cv::Mat& frame, std::vector<uchar>& data) {
+		//The reader may let go of its reference on its own thread meanwhile, so the count is read atomically
+		if (frame.u != NULL && CV_XADD(&frame.u->refcount, 0) > 1)
+			frame.release();
+
+		//A failed decode returns an empty Mat but may leave the buffer as it was, older OpenCV returns the buffer itself
+		//so data without a JPEG start of image doesn't reach it
+		if (this->parallel && this->dicom.GetFrameData(index, data) && data.size() > 2 && data[0] == 0xFF && data[1] == 0xD8) {
+			if (!cv::imdecode(data, this->gray ? cv::IMREAD_GRAYSCALE : cv::IMREAD_UNCHANGED, &frame).empty())
+				return;
+		}
+
+		//Dicom serialises DCMTK decoding itself
+		if (!(this->gray ? this->dicom.GetGrayFrame(frame, index) : this->dicom.GetFrame(frame, index)))
+			frame.release();
+	};
+};
@@ -1,5 +1,7 @@
 #include <opencv2/opencv.hpp>
 
+#include "MotionField.hpp"
+
 namespace Draw {
 	inline float square(float x) {
 		return x * x;
@@ -80,9 +82,25 @@ namespace Draw {
 		}
 	}
 
-	template<typename T, typename X>
-	void MotionVectorHSVAngles(cv::Mat &canvas, T *& motionVectors, X *& motionDetails, unsigned int wB, unsigned int hB, int blockSize, int stepSize,
-		int thresh = 1, float min_len = 0.0) {
+	void MotionVectors(cv::Mat &canvas, const MotionField& field, bool drawGrid = false,
+		cv::Scalar rectColour = cv::Scalar(255), cv::Scalar lineColour = cv::Scalar(0, 255, 255)) {
+		//Offset drawn point to represent middle rather than top left of block
+		cv::Point offset(field.GetBlockSize() / 2, field.GetBlockSize() / 2);
+
+		for (int idx = 0; idx < field.GetCount(); idx++) {
+			cv::Point pos = field.GetOrigin(idx);
+
+			if (drawGrid)
+				cv::rectangle(canvas, pos, pos + cv::Point(field.GetBlockSize(), field.GetBlockSize()), rectColour);
+
+			cv::arrowedLine(canvas, pos + offset, field.GetRefPoint(idx) + offset, lineColour);
+		}
+	}
+
+	//Shared by the overloads below, angleOf(idx) and lengthOf(idx) give the angle and magnitude of each block
+	template<typename Angle, typename Length>
+	void HSVAngles(cv::Mat &canvas, Angle angleOf, Length lengthOf, unsigned int wB, unsigned int hB, int blockSize, int stepSize,
+		int thresh, float min_len) {
 
 		cv::Mat mask;
 		cv::cvtColor(canvas, mask, cv::COLOR_RGB2GRAY);
@@ -101,11 +119,10 @@ namespace Draw {
 				//Offset drawn point to represent middle rather than top left of block
 				cv::Point offset(blockSize / 2, blockSize / 2);
 				cv::Point pos(i * stepSize, j * stepSize);
-				cv::Point mVec(motionVectors[idx].x, motionVectors[idx].y);
 
-				float len = (motionDetails[idx].y / max_len);
+				float len = (lengthOf(idx) / max_len);
 				if (len >= min_len) {
-					float angle = motionDetails[idx].x;
+					float angle = angleOf(idx);
 
 					cv::rectangle(colour_image, pos, pos + cv::Point(blockSize, blockSize), HSVToBGR(angle, len, 1), CV_FILLED);
 
@@ -148,8 +165,31 @@ namespace Draw {
 		//cv::addWeighted(canvas, 0.5, colour_image, 0.5, 0.0, canvas);
 	}
 
-	void Text(cv::Mat& canvas, std::string f, std::string bS, std::string sS, std::string processed_fps, std::string rendered_fps, cv::Scalar colour = cv::Scalar(255, 255, 255)) {
+	template<typename T, typename X>
+	void MotionVectorHSVAngles(cv::Mat &canvas, T *& motionVectors, X *& motionDetails, unsigned int wB, unsigned int hB, int blockSize, int stepSize,
+		int thresh = 1, float min_len = 0.0) {
+		X * details = motionDetails;
+		HSVAngles(canvas, [details](int idx) { return details[idx].x; }, [details](int idx) { return details[idx].y; }, wB, hB, blockSize, stepSize, thresh, min_len);
+	}
+
+	void MotionVectorHSVAngles(cv::Mat &canvas, const MotionField& field, int thresh = 1, float min_len = 0.0) {
+		const float * angles = field.GetAngles();
+		const float * magnitudes = field.GetMagnitudes();
+		HSVAngles(canvas, [angles](int idx) { return angles[idx]; }, [magnitudes](int idx) { return magnitudes[idx]; },
+			field.GetWB(), field.GetHB(), field.GetBlockSize(), field.GetStepSize(), thresh, min_len);
+	}
+
+	void BPM(cv::Mat& canvas, float bpm, cv::Scalar colour = cv::Scalar(255, 255, 255)) {
+		std::string content = bpm > 0 ? "BPM: " + std::to_string((int)std::round(bpm)) : std::string("BPM: --");
+		cv::putText(canvas, content, cv::Point(0, 16), cv::FONT_HERSHEY_COMPLEX_SMALL, 0.8, colour);
+	}
+
+	//The engine, when given, goes on the line above the rest
+	void Text(cv::Mat& canvas, std::string f, std::string bS, std::string sS, std::string processed_fps, std::string rendered_fps, std::string engine = "", cv::Scalar colour = cv::Scalar(255, 255, 255)) {
 		std::string content("Frame " + f + ", Block Size: " + bS + ", Step Size: " + sS + ", Processed FPS: " + processed_fps + ", Rendered FPS: " + rendered_fps);
 		cv::putText(canvas, content, cv::Point(0, canvas.size().height - 1), cv::FONT_HERSHEY_COMPLEX_SMALL, 0.6, colour);
+
+		if (!engine.empty())
+			cv::putText(canvas, "Engine: " + engine, cv::Point(0, canvas.size().height - 14), cv::FONT_HERSHEY_COMPLEX_SMALL, 0.6, colour);
 	}
 }
\ No newline at end of file
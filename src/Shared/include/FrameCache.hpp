@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+#include <atomic>
+
+#include <opencv2/opencv.hpp>
+
+//Frames of one pass over a looping input, kept so later passes are served from memory instead of decoding the file
+//again. The slots are allocated up front for as many frames as the budget holds, and the cache is given up as soon as
+//the first pass has more frames than that, so a clip that is too long is streamed on every pass as before.
+//
+//Admit() and Complete() are called by the thread reading the input, Store() and Get() by the thread converting the
+//frames, which sees every frame after it was admitted and only reads slots of a pass that has been completed.
+class FrameCache {
+public:
+	//frameBytes is the memory a cached frame takes, the colour ROI and its gray copy
+	FrameCache(size_t budget, size_t frameBytes) {
+		size_t capacity = frameBytes > 0 ? budget / frameBytes : 0;
+		this->slots.resize(capacity);
+		this->enabled = capacity > 0;
+	};
+
+	//Slot for the next frame of the first pass, -1 once the cache is disabled
+	int Admit() {
+		if (!this->enabled)
+			return -1;
+
+		if (this->admitted == this->slots.size()) {
+			this->enabled = false;
+			return -1;
+		}
+
+		return (int)this->admitted++;
+	};
+
+	//End of the first pass, true if every frame of it was admitted
+	bool Complete() {
+		this->complete = this->enabled && this->admitted > 0;
+		return this->complete;
+	};
+
+	bool IsComplete() const {
+		return this->complete;
+	};
+
+	size_t GetFrameCount() const {
+		return this->admitted;
+	};
+
+	//Copies of the colour ROI and gray frame. Memory is handed back on the first call after the cache was given up
+	void Store(int slot, const cv::Mat& colour, const cv::Mat& gray) {
+		if (!this->enabled) {
+			this->Release();
+			return;
+		}
+
+		if (slot < 0)
+			return;
+
+		colour.copyTo(this->slots[slot].colour);
+		gray.copyTo(this->slots[slot].gray);
+	};
+
+	//Headers of a stored frame, the data is shared and must not be written to
+	void Get(int slot, cv::Mat& colour, cv::Mat& gray) const {
+		colour = this->slots[slot].colour;
+		gray = this->slots[slot].gray;
+	};
+private:
+	struct Slot {
+		cv::Mat colour, gray;
+	};
+
+	std::vector<Slot> slots;
+	size_t admitted = 0;
+	std::atomic<bool> enabled{ false };
+	bool complete = false, released = false;
+
+	void Release() {
+		if (this->released)
+			return;
+
+		for (size_t i = 0; i < this->slots.size(); i++) {
+			this->slots[i].colour.release();
+			this->slots[i].gray.release();
+		}
+
+		this->released = true;
+	};
+};
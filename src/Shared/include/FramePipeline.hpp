@@ -0,0 +1,386 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameSource.hpp"
+#include "MotionField.hpp"
+#include "SPSCQueue.hpp"
+#include "FrameCache.hpp"
+#include "Timer.hpp"
+
+//A frame travelling through the pipeline. Packets are allocated once and circulate, so the decode and gray buffers and
+//the motion field are reused like the buffers of the serial loop were.
+struct FramePacket {
+	//Position reported by the source and the number of times the input has restarted
+	int index = 0, sequence = 0;
+
+	//First frame of a sequence has no previous frame and is not matched
+	bool first = false;
+
+	//Slot of the frame in the loop cache, cached frames aren't decoded and take colour and gray from the cache
+	int cache_slot = -1;
+	bool cached = false;
+
+	//Frame as decoded, colour is the ROI of decoded, gray its grayscale copy and prevGray shares the gray of the
+	//previous frame. decoded and colour are empty when the pipeline was made without colour, gray is then read from the
+	//source directly
+	cv::Mat decoded, colour, gray, prevGray;
+
+	//Written by the match stage, engine names the search that made the field for the display
+	MotionField field;
+	float processed_fps = 0;
+	std::string engine;
+
+	//Written by the analyse stage, bpm is 0 until enough frames have been seen
+	cv::Vec4f averages;
+	float bpm = 0;
+
+	//Called before a new frame is written to gray. The old gray is still the prevGray of the next packet, so the buffer
+	//of prevGray is written to instead once the packet before has let go of it, and a new one only if something else
+	//(the cache, an engine) still holds both
+	void RecycleGray() {
+		if (!IsOwned(this->gray))
+			this->gray = IsOwned(this->prevGray) ? this->prevGray : cv::Mat();
+
+		this->prevGray.release();
+	};
+
+	//Sole header of memory OpenCV allocated, a view of memory it doesn't own (a mapped frame stack) never is. The count
+	//is read atomically like Mat::release() changes it, as the header that shared the buffer may be let go on another thread
+	static bool IsOwned(const cv::Mat& mat) {
+		return mat.u != NULL && CV_XADD(&mat.u->refcount, 0) == 1;
+	};
+};
+
+//Runs decode, convert, match and analyse on their own threads connected by bounded SPSC queues, the render stage is
+//the thread calling Pop()/Release() as HighGUI has to stay on the main thread. While frame N is being matched frame N+1
+//is decoded and converted and frame N-1 analysed and rendered. A fixed set of packets circulates from the render stage
+//back to the decode stage so the number of frames in flight is bounded and no stage allocates per frame.
+//
+//Every packet carries both frames of its pair, so several match stages can run at once for offline processing. Frames
+//are dealt to them in runs of chunk consecutive frames and collected in the same order, so the analyse and render stages
+//still see every frame in order. The match and analyse stages run the functions given to Start() and are the only
+//threads to call them, any state they share with the render stage has to be passed through the packet or an SPSCQueue.
+//
+//When looping, the converted frames of the first pass are kept in a FrameCache of cache_budget bytes and every later
+//pass is served from it without touching the source, unless the input turned out to be longer than the budget.
+//
+//Frames are only kept in colour when the pipeline is made with colour, for a render stage drawing on them. Otherwise the
+//decode stage reads the gray ROI from the source, which converts only the ROI and only once.
+class FramePipeline {
+public:
+	typedef std::function<void(FramePacket&)> Stage;
+
+	//first is the frame already read from source (e.g. for ROI selection), it's sent as the first frame of the pipeline
+	FramePipeline(FrameSource& source, const cv::Mat& first, cv::Rect roi, bool set_roi, bool loop, bool colour = true, size_t cache_budget = 0, int depth = 4)
+		: source(source), cache(loop ? cache_budget : 0, (set_roi ? (size_t)roi.area() : first.total()) * ((colour ? first.elemSize() : 0) + 1)) {
+		first.copyTo(this->first);
+		this->roi = roi;
+		this->set_roi = set_roi;
+		this->loop = loop;
+		this->colour = colour;
+		this->depth = depth;
+	};
+
+	~FramePipeline() {
+		this->Stop();
+	};
+
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	//Records decode, gray, match and analyse latency of every frame into timers, which must outlive the pipeline. Only
+	//before Start(), nothing is timed without it
+	void SetLatency(StageTimers * timers) {
+		this->latency = timers;
+	};
+
+	void Start(Stage match, Stage analyse) {
+		this->Start(std::vector<Stage>(1, match), analyse, 1);
+	};
+
+	//One match thread per entry of match, each taking chunk consecutive frames at a time
+	void Start(const std::vector<Stage>& match, Stage analyse, int chunk) {
+		this->match = match;
+		this->analyse = analyse;
+		this->chunk = std::max(1, chunk);
+
+		//Enough packets for every match stage to hold a chunk while the next chunks are decoded
+		int queue_size = std::max(this->depth, 2 * this->chunk);
+		int packet_count = std::max(this->depth, ((int)match.size() + 1) * this->chunk + 2);
+
+		this->decoded.reset(new SPSCQueue<FramePacket*>(this->depth));
+		this->analysed.reset(new SPSCQueue<FramePacket*>(this->depth));
+		this->free.reset(new SPSCQueue<FramePacket*>(packet_count));
+
+		for (int i = 0; i < packet_count; i++) {
+			this->packets.emplace_back(new FramePacket());
+			this->free->TryPush(this->packets.back().get());
+		}
+
+		for (size_t i = 0; i < match.size(); i++) {
+			this->converted.emplace_back(new SPSCQueue<FramePacket*>(queue_size));
+			this->matched.emplace_back(new SPSCQueue<FramePacket*>(queue_size));
+		}
+
+		this->threads.emplace_back(&FramePipeline::Decode, this);
+		this->threads.emplace_back(&FramePipeline::Convert, this);
+
+		for (size_t i = 0; i < match.size(); i++)
+			this->threads.emplace_back(&FramePipeline::Run, this, std::ref(*this->converted[i]), std::ref(*this->matched[i]), std::ref(this->match[i]));
+
+		this->threads.emplace_back(&FramePipeline::Analyse, this);
+	};
+
+	//Render stage, waits for the next analysed frame. False once the input has ended and every frame was delivered, the
+	//first exception thrown by a stage is rethrown here instead
+	bool Pop(FramePacket *& packet) {
+		if (this->analysed->Pop(packet))
+			return true;
+
+		std::lock_guard<std::mutex> lock(this->error_lock);
+		if (this->error)
+			std::rethrow_exception(this->error);
+
+		return false;
+	};
+
+	//Render stage, hands a packet from Pop() back to the decode stage
+	void Release(FramePacket * packet) {
+		this->free->Push(packet);
+	};
+
+	//Ends every stage without draining, frames in flight are dropped. Joins the threads so stage state can be read after
+	void Stop() {
+		this->stop = true;
+
+		if (this->threads.empty())
+			return;
+
+		this->decoded->Close();
+		this->analysed->Close();
+		this->free->Close();
+
+		for (size_t i = 0; i < this->converted.size(); i++) {
+			this->converted[i]->Close();
+			this->matched[i]->Close();
+		}
+
+		for (size_t i = 0; i < this->threads.size(); i++)
+			this->threads[i].join();
+
+		this->threads.clear();
+	};
+private:
+	FrameSource& source;
+	cv::Mat first;
+	cv::Rect roi;
+	bool set_roi, loop, colour;
+	int depth, chunk = 1;
+	std::atomic<bool> stop{ false };
+	FrameCache cache;
+	StageTimers * latency = NULL;
+
+	std::vector<Stage> match;
+	Stage analyse;
+	std::vector<std::unique_ptr<FramePacket>> packets;
+	std::vector<std::thread> threads;
+	std::exception_ptr error;
+	std::mutex error_lock;
+
+	//Decode to convert, convert to each match stage, each match stage to analyse, analyse to render and render to decode
+	std::unique_ptr<SPSCQueue<FramePacket*>> decoded, analysed, free;
+	std::vector<std::unique_ptr<SPSCQueue<FramePacket*>>> converted, matched;
+
+	void Decode() {
+		FramePacket * packet;
+		int sequence = 0, position = 0;
+		bool first = true;
+
+		while (!this->stop && this->free->Pop(packet)) {
+			bool cached = this->cache.IsComplete();
+
+			if (first && sequence == 0) {
+				this->ReadFirst(*packet);
+			}
+			else if (!cached) {
+				ScopedTimer timer(this->Timed(StageTimers::Decode));
+				this->Read(*packet);
+			}
+
+			//Restart from the first frame if loop, from memory once the cache holds the whole first pass
+			if (cached ? position == (int)this->cache.GetFrameCount() : this->IsEmpty(*packet)) {
+				if (!this->loop)
+					break;
+
+				sequence++;
+				first = true;
+				cached = cached || this->cache.Complete();
+
+				if (cached) {
+					position = 0;
+				}
+				else {
+					this->source.SetPos(0);
+					this->Read(*packet);
+
+					if (this->IsEmpty(*packet))
+						break;
+				}
+			}
+
+			if (cached) {
+				packet->cache_slot = position++;
+				packet->index = position;
+			}
+			else {
+				packet->cache_slot = sequence == 0 ? this->cache.Admit() : -1;
+				packet->index = this->source.GetPos();
+			}
+
+			packet->cached = cached;
+			packet->sequence = sequence;
+			packet->first = first;
+			first = false;
+
+			if (!this->decoded->Push(packet))
+				break;
+		}
+
+		this->decoded->Close();
+	};
+
+	//The gray frame of the previous packet is shared with the next so each packet is a complete pair without a copy, the
+	//match stages hold no frames. No stage writes to a frame after it is converted until RecycleGray() finds it unshared
+	void Convert() {
+		FramePacket * packet;
+		cv::Mat last;
+		int n = 0;
+
+		try {
+			while (this->decoded->Pop(packet)) {
+				if (packet->first)
+					last.release();
+
+				if (packet->cached) {
+					this->cache.Get(packet->cache_slot, packet->colour, packet->gray);
+				}
+				else {
+					ScopedTimer timer(this->Timed(StageTimers::Gray));
+
+					if (this->colour) {
+						packet->RecycleGray();
+						Util::toGray(packet->colour, packet->gray);
+					}
+
+					this->cache.Store(packet->cache_slot, packet->colour, packet->gray);
+				}
+
+				packet->prevGray = last;
+				last = packet->gray;
+
+				if (!this->converted[(n++ / this->chunk) % this->converted.size()]->Push(packet))
+					break;
+			}
+		}
+		catch (...) {
+			this->SetError();
+		}
+
+		for (size_t i = 0; i < this->converted.size(); i++)
+			this->converted[i]->Close();
+	};
+
+	void Read(FramePacket& packet) {
+		if (this->colour) {
+			this->source >> packet.decoded;
+			packet.colour = this->set_roi && !packet.decoded.empty() ? packet.decoded(this->roi) : packet.decoded;
+		}
+		else {
+			packet.RecycleGray();
+			this->source.ReadGray(packet.gray, this->set_roi ? this->roi : cv::Rect());
+		}
+	};
+
+	void ReadFirst(FramePacket& packet) {
+		if (this->colour) {
+			this->first.copyTo(packet.decoded);
+			packet.colour = this->set_roi ? packet.decoded(this->roi) : packet.decoded;
+		}
+		else {
+			Util::toGray(FrameSource::Crop(this->first, this->set_roi ? this->roi : cv::Rect()), packet.gray);
+		}
+	};
+
+	bool IsEmpty(const FramePacket& packet) {
+		return this->colour ? packet.decoded.empty() : packet.gray.empty();
+	};
+
+	//Frames are taken back from the match stages in the order Convert() dealt them
+	void Analyse() {
+		FramePacket * packet;
+		int n = 0;
+
+		try {
+			while (this->matched[(n++ / this->chunk) % this->matched.size()]->Pop(packet)) {
+				{
+					ScopedTimer timer(this->Timed(StageTimers::Analyse, packet));
+					this->analyse(*packet);
+				}
+
+				if (!this->analysed->Push(packet))
+					break;
+			}
+		}
+		catch (...) {
+			this->SetError();
+		}
+
+		this->analysed->Close();
+	};
+
+	//Histogram of stage if timing, first frames of a pass are passed through unmatched and not counted
+	LatencyHistogram * Timed(StageTimers::Stage stage, const FramePacket * packet = NULL) {
+		return this->latency && !(packet && packet->first) ? (*this->latency)[stage] : NULL;
+	};
+
+	void SetError() {
+		std::lock_guard<std::mutex> lock(this->error_lock);
+		if (!this->error)
+			this->error = std::current_exception();
+	};
+
+	//Closing the output when the input ends lets the end of the file travel down the pipeline behind the last frame
+	void Run(SPSCQueue<FramePacket*>& in, SPSCQueue<FramePacket*>& out, const Stage& stage) {
+		FramePacket * packet;
+
+		try {
+			while (in.Pop(packet)) {
+				{
+					ScopedTimer timer(this->Timed(StageTimers::Match, packet));
+					stage(*packet);
+				}
+
+				if (!out.Push(packet))
+					break;
+			}
+		}
+		catch (...) {
+			this->SetError();
+
+			//Upstream stages stop once they can't push
+			in.Close();
+		}
+
+		out.Close();
+	};
+};
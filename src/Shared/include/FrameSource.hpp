@@ -0,0 +1,191 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <memory>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "Capture.hpp"
+#include "FrameStack.hpp"
+#include "Utils.hpp"
+#include "DecodeBudget.hpp"
+
+#ifdef USE_DCMTK
+#include "Dicom.hpp"
+#include "DicomPrefetcher.hpp"
+#endif
+
+//Frames of a video, frame stack or DICOM study behind one interface, so the applications and the pipeline don't depend
+//on what the input is. ReadGray() gives the ROI of the next frame as 8 bit gray converted once from a crop of the
+//decoded frame, Read() the frame as decoded for when it's going to be drawn on.
+class FrameSource {
+public:
+	virtual ~FrameSource() {};
+
+	//Next frame as decoded, BGR or gray, empty after the last one
+	virtual void Read(cv::Mat& frame) = 0;
+
+	//Next frame cropped to roi (the whole frame when empty) and converted to gray. Only the crop is converted as it is
+	//a header of the decoded frame, sources that hold gray frames already override this
+	virtual void ReadGray(cv::Mat& gray, cv::Rect roi) {
+		this->Read(this->frame);
+
+		if (this->frame.empty())
+			gray.release();
+		else
+			Util::toGray(Crop(this->frame, roi), gray);
+	};
+
+	cv::Mat& operator>> (cv::Mat& in) {
+		this->Read(in);
+		return in;
+	};
+
+	virtual bool IsOpened() = 0;
+	virtual void SetPos(int index = 0) = 0;
+	virtual int GetPos() = 0;
+	virtual int GetWidth() = 0;
+	virtual int GetHeight() = 0;
+	virtual int GetFrameCount() = 0;
+
+	//Frames per second, 0 if the input doesn't say
+	virtual double GetFrameRate() = 0;
+
+	static cv::Mat Crop(const cv::Mat& frame, cv::Rect roi) {
+		return roi.area() > 0 ? frame(roi & cv::Rect(0, 0, frame.cols, frame.rows)) : frame;
+	};
+
+	//Source for path by its extension, a video unless it is a .stack (or .dcm when built with DCMTK). Without colour a
+	//DICOM study is only decoded to gray. Null when the input can't be opened
+	static std::unique_ptr<FrameSource> Open(const std::string& path, bool colour = true, int decodeThreads = 2, DecodeBudget * budget = NULL);
+protected:
+	cv::Mat frame;
+};
+
+class VideoSource : public FrameSource {
+public:
+	VideoSource(const std::string& path) : capture(path) {};
+
+	void Read(cv::Mat& frame) { this->capture >> frame; };
+	bool IsOpened() { return this->capture.IsOpened(); };
+	void SetPos(int index = 0) { this->capture.SetPos(index); };
+	int GetPos() { return this->capture.GetPos(); };
+	int GetWidth() { return this->capture.GetWidth(); };
+	int GetHeight() { return this->capture.GetHeight(); };
+	int GetFrameCount() { return this->capture.GetFrameCount(); };
+	double GetFrameRate() { return this->capture.GetFrameRate(); };
+private:
+	Capture capture;
+};
+
+//Frames are already gray, ReadGray() hands out a view of the mapped file without a copy which must not be written to
+class StackSource : public FrameSource {
+public:
+	StackSource(const std::string& path) : stack(path) {};
+
+	void Read(cv::Mat& frame) { this->stack >> frame; };
+
+	void ReadGray(cv::Mat& gray, cv::Rect roi) {
+		this->stack >> gray;
+
+		if (!gray.empty())
+			gray = Crop(gray, roi);
+	};
+
+	bool IsOpened() { return this->stack.IsOpened(); };
+	void SetPos(int index = 0) { this->stack.SetPos(index); };
+	int GetPos() { return this->stack.GetPos(); };
+	int GetWidth() { return this->stack.GetWidth(); };
+	int GetHeight() { return this->stack.GetHeight(); };
+	int GetFrameCount() { return this->stack.GetFrameCount(); };
+	double GetFrameRate() { return this->stack.GetFrameRate(); };
+private:
+	FrameStack stack;
+};
+
+#ifdef USE_DCMTK
+//Frames are decoded ahead by a DicomPrefetcher, which is started again from the new position on SetPos(). A file that
+//didn't load has no prefetcher and reads as empty
+class DicomSource : public FrameSource {
+public:
+	DicomSource(const std::string& path, bool colour, int threads, DecodeBudget * budget = NULL) : dicom(path, true) {
+		this->colour = colour;
+		this->threads = threads;
+		this->budget = budget;
+		this->SetPos(0);
+	};
+
+	void Read(cv::Mat& frame) {
+		if (this->prefetcher)
+			*this->prefetcher >> frame;
+		else
+			frame.release();
+	};
+
+	bool IsOpened() { return this->dicom.IsLoaded() && this->dicom.GetFrameCount() > 0; };
+
+	void SetPos(int index = 0) {
+		//The old prefetcher's threads are joined before the new one starts decoding
+		this->prefetcher.reset();
+
+		if (this->IsOpened())
+			this->prefetcher.reset(new DicomPrefetcher(this->dicom, this->threads, 8, !this->colour, index, this->budget));
+	};
+
+	int GetPos() { return this->prefetcher ? this->prefetcher->GetPos() : 0; };
+	int GetWidth() { return this->dicom.GetWidth(); };
+	int GetHeight() { return this->dicom.GetHeight(); };
+	int GetFrameCount() { return this->dicom.GetFrameCount(); };
+	double GetFrameRate() { return this->dicom.GetFrameRate(); };
+private:
+	Dicom dicom;
+	std::unique_ptr<DicomPrefetcher> prefetcher;
+	DecodeBudget * budget;
+	bool colour;
+	int threads;
+};
+#endif
+
+inline std::unique_ptr<FrameSource> FrameSource::Open(const std::string& path, bool colour, int decodeThreads, DecodeBudget * budget) {
+	std::unique_ptr<FrameSource> source;
+
+	if (FrameStack::IsFrameStack(path))
+		source.reset(new StackSource(path));
+#ifdef USE_DCMTK
+	else if (path.size() > 4 && path.compare(path.size() - 4, 4, ".dcm") == 0)
+		source.reset(new DicomSource(path, colour, decodeThreads, budget));
+#endif
+	else
+		source.reset(new VideoSource(path));
+
+	if (!source->IsOpened()) {
+		std::cerr << "Could not open " << path << std::endl;
+		source.reset();
+	}
+
+	return source;
+}
+
+//Consecutive gray frames of a source as (Prev(), Curr()) pairs. The two buffers swap on every Next() so the frame read
+//last becomes the previous one without a copy, and the next frame is read into the buffer of the one before it.
+class FramePairs {
+public:
+	FramePairs(FrameSource& source, cv::Rect roi) : source(source) {
+		this->roi = roi;
+	};
+
+	//False at the end of the source. The first call only reads the frame the first pair is matched against
+	bool Next() {
+		std::swap(this->prev, this->curr);
+		this->source.ReadGray(this->curr, this->roi);
+		return !this->curr.empty();
+	};
+
+	const cv::Mat& Prev() const { return this->prev; };
+	const cv::Mat& Curr() const { return this->curr; };
+private:
+	FrameSource& source;
+	cv::Rect roi;
+	cv::Mat prev, curr;
+};
@@ -0,0 +1,284 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <opencv2/opencv.hpp>
+
+//Preprocessed study: the ROI of every frame already converted to 8 bit gray, so repeated runs over the same study skip
+//decoding, cropping and conversion. Rows are padded to a multiple of 64 bytes and frames start on a 4096 byte boundary
+//after the header, so the frames of a mapped file are aligned views straight into the page cache.
+struct FrameStackHeader {
+	char magic[8];
+	uint32_t version, width, height, stride;
+	uint32_t frame_count;
+	uint32_t roi_x, roi_y, roi_width, roi_height;
+	uint64_t data_offset, frame_bytes;
+	double frame_time;
+
+	static const uint32_t VERSION = 1;
+	static const uint32_t ROW_ALIGNMENT = 64;
+	static const uint32_t FRAME_ALIGNMENT = 4096;
+
+	static bool IsMagic(const char * magic) {
+		return std::memcmp(magic, "BMSTACK", 8) == 0;
+	};
+
+	//Whether the frames lie within a file of size bytes, so views of them never reach past the mapping. The frame count
+	//is checked by division so a corrupt header can't overflow the product
+	bool Fits(uint64_t size) const {
+		if (this->width == 0 || this->height == 0 || this->width > INT_MAX || this->height > INT_MAX || this->stride < this->width
+			|| this->frame_bytes < (uint64_t)this->stride * this->height)
+			return false;
+
+		if (this->data_offset < sizeof(FrameStackHeader) || this->data_offset > size)
+			return false;
+
+		return this->frame_count <= (size - this->data_offset) / this->frame_bytes;
+	};
+};
+
+//Writes a stack frame by frame, the frame count in the header is filled in by Close
+class FrameStackWriter {
+public:
+	//frameTime in milliseconds like the DICOM FrameTime tag, roi is where the frames were cropped from in the original
+	FrameStackWriter(const std::string& path, int width, int height, double frameTime, cv::Rect roi)
+		: out(path, std::ios::binary | std::ios::trunc) {
+		std::memset(&this->header, 0, sizeof(this->header));
+		std::memcpy(this->header.magic, "BMSTACK", 8);
+		this->header.version = FrameStackHeader::VERSION;
+		this->header.width = width;
+		this->header.height = height;
+		this->header.stride = Align(width, FrameStackHeader::ROW_ALIGNMENT);
+		this->header.roi_x = roi.x;
+		this->header.roi_y = roi.y;
+		this->header.roi_width = roi.width;
+		this->header.roi_height = roi.height;
+		this->header.frame_time = frameTime;
+		this->header.frame_bytes = Align((uint64_t)this->header.stride * height, FrameStackHeader::FRAME_ALIGNMENT);
+		this->header.data_offset = Align(sizeof(FrameStackHeader), FrameStackHeader::FRAME_ALIGNMENT);
+
+		if (!this->out.good())
+			throw std::runtime_error("Could not create frame stack: " + path);
+
+		//Header is rewritten with the frame count on Close
+		this->WriteHeader();
+		this->row.assign(this->header.stride, 0);
+	};
+
+	~FrameStackWriter() {
+		this->Close();
+	};
+
+	//Frame must be 8 bit gray of the stack's size
+	void Add(const cv::Mat& gray) {
+		if (gray.type() != CV_8UC1 || gray.cols != (int)this->header.width || gray.rows != (int)this->header.height)
+			throw std::runtime_error("Frame stack frames must be 8 bit gray of " + std::to_string(this->header.width) + "x" + std::to_string(this->header.height));
+
+		for (int y = 0; y < gray.rows; y++) {
+			std::memcpy(this->row.data(), gray.ptr<uchar>(y), gray.cols);
+			this->out.write((const char *)this->row.data(), this->row.size());
+		}
+
+		//Pad the frame to the next page
+		uint64_t padding = this->header.frame_bytes - (uint64_t)this->header.stride * this->header.height;
+		if (padding > 0) {
+			std::vector<char> zeros((size_t)padding, 0);
+			this->out.write(zeros.data(), zeros.size());
+		}
+
+		this->header.frame_count++;
+	};
+
+	void Close() {
+		if (!this->out.is_open())
+			return;
+
+		this->WriteHeader();
+		this->out.close();
+
+		if (this->out.fail())
+			std::cerr << "Could not write frame stack, it is incomplete" << std::endl;
+	};
+
+	int GetFrameCount() {
+		return this->header.frame_count;
+	};
+
+	static uint64_t Align(uint64_t size, uint64_t alignment) {
+		return (size + alignment - 1) / alignment * alignment;
+	};
+private:
+	std::ofstream out;
+	FrameStackHeader header;
+	std::vector<uchar> row;
+
+	void WriteHeader() {
+		std::streampos position = this->out.tellp();
+		this->out.seekp(0);
+
+		std::vector<char> block((size_t)this->header.data_offset, 0);
+		std::memcpy(block.data(), &this->header, sizeof(this->header));
+		this->out.write(block.data(), block.size());
+
+		if (position > (std::streampos)block.size())
+			this->out.seekp(position);
+	};
+};
+
+//Reads a stack like a Capture reads a video. The file is mapped read only and every frame handed out is a view of the
+//mapping, no copy is made, so frames must not be written to and are only valid while the FrameStack exists.
+class FrameStack {
+public:
+	FrameStack(const std::string& path) {
+		this->path = path;
+		this->Map();
+	};
+
+	~FrameStack() {
+		this->Unmap();
+	};
+
+	FrameStack(const FrameStack&) = delete;
+	FrameStack& operator=(const FrameStack&) = delete;
+
+	//Next frame, empty after the last one
+	cv::Mat& operator>> (cv::Mat& in)
+	{
+		if (!this->IsOpened() || this->frame_index >= (int)this->header.frame_count) {
+			in.release();
+			return in;
+		}
+
+		in = this->GetFrame(this->frame_index++);
+		return in;
+	};
+
+	cv::Mat GetFrame(int index) {
+		uchar * data = this->data + this->header.data_offset + this->header.frame_bytes * index;
+		return cv::Mat(this->header.height, this->header.width, CV_8UC1, data, this->header.stride);
+	};
+
+	void Reset() { this->frame_index = 0; };
+
+	bool IsOpened() { return this->data != NULL; };
+
+	int GetWidth() { return this->header.width; };
+
+	int GetHeight() { return this->header.height; };
+
+	void SetPos(int index = 0) { this->frame_index = std::max(0, std::min(index, (int)this->header.frame_count)); };
+
+	int GetPos() { return this->frame_index; };
+
+	int GetFrameCount() { return this->header.frame_count; };
+
+	double GetFrameTime() { return this->header.frame_time; };
+
+	double GetFrameRate() { return this->header.frame_time > 0 ? 1000.0 / this->header.frame_time : 0; };
+
+	//Region of the original frames the stack was cropped to
+	cv::Rect GetROI() { return cv::Rect(this->header.roi_x, this->header.roi_y, this->header.roi_width, this->header.roi_height); };
+
+	bool isLastFrame() { return (int)this->header.frame_count - 1 == this->frame_index; };
+
+	static bool IsFrameStack(const std::string& path) {
+		return path.size() > 6 && path.compare(path.size() - 6, 6, ".stack") == 0;
+	};
+private:
+	std::string path;
+	FrameStackHeader header;
+	uchar * data = NULL;
+	size_t size = 0;
+	int frame_index = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE, mapping = NULL;
+#endif
+
+	void Map() {
+		std::memset(&this->header, 0, sizeof(this->header));
+
+#ifdef _WIN32
+		this->file = CreateFileA(this->path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		LARGE_INTEGER file_size;
+
+		if (this->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->file, &file_size)) {
+			std::cerr << "Could not open frame stack: " << this->path << std::endl;
+			return this->Unmap();
+		}
+
+		this->size = (size_t)file_size.QuadPart;
+		this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		this->data = this->mapping ? (uchar *)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+		int fd = open(this->path.c_str(), O_RDONLY);
+		struct stat st;
+
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			std::cerr << "Could not open frame stack: " << this->path << std::endl;
+			if (fd >= 0)
+				close(fd);
+			return;
+		}
+
+		this->size = (size_t)st.st_size;
+		void * mapped = this->size > 0 ? mmap(NULL, this->size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+		close(fd);
+
+		//Frames are read in order, let the kernel read ahead
+		if (mapped != MAP_FAILED) {
+			madvise(mapped, this->size, MADV_SEQUENTIAL);
+			this->data = (uchar *)mapped;
+		}
+#endif
+
+		if (this->data == NULL || this->size < sizeof(FrameStackHeader)) {
+			std::cerr << "Could not map frame stack: " << this->path << std::endl;
+			return this->Unmap();
+		}
+
+		std::memcpy(&this->header, this->data, sizeof(this->header));
+
+		if (!FrameStackHeader::IsMagic(this->header.magic) || this->header.version != FrameStackHeader::VERSION || !this->header.Fits(this->size)) {
+			std::cerr << "Not a frame stack or truncated: " << this->path << std::endl;
+			return this->Unmap();
+		}
+	};
+
+	void Unmap() {
+#ifdef _WIN32
+		if (this->data)
+			UnmapViewOfFile(this->data);
+		if (this->mapping)
+			CloseHandle(this->mapping);
+		if (this->file != INVALID_HANDLE_VALUE)
+			CloseHandle(this->file);
+
+		this->mapping = NULL;
+		this->file = INVALID_HANDLE_VALUE;
+#else
+		if (this->data)
+			munmap(this->data, this->size);
+#endif
+
+		this->data = NULL;
+		std::memset(&this->header, 0, sizeof(this->header));
+	};
+};
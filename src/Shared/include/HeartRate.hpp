@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <algorithm>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+//Online replacement for the FFT of scripts/HeartPlot.m. The average angle of every frame is fed in and a sliding DFT keeps
+//the spectrum of the last window samples, only for the bins within the heart rate range, so each sample costs O(bins)
+//rather than an FFT of the window. The dominant bin is refined with a parabola through the power of its neighbours as a
+//window of a few seconds only gives a resolution of 60 * frameRate / window BPM per bin.
+class HeartRate {
+public:
+	//frameRate of the input in frames per second, e.g. 1000 / FrameTime of a DICOM file
+	HeartRate(float frameRate, int window = 256, float minBPM = 40, float maxBPM = 200) {
+		this->frameRate = frameRate;
+		this->window = std::max(8, window);
+
+		//Bins k with frequency k * frameRate / window within [minBPM, maxBPM], never the DC bin. No bins without a frame rate
+		float binBPM = 60.0f * frameRate / this->window;
+		this->firstBin = frameRate > 0 ? std::max(1, (int)std::floor(minBPM / binBPM)) : 1;
+		int lastBin = frameRate > 0 ? std::min(this->window / 2, (int)std::ceil(maxBPM / binBPM)) : 0;
+
+		for (int k = this->firstBin; k <= lastBin; k++)
+			this->twiddles.push_back(std::polar(this->damping, (float)(2.0 * M_PI * k / this->window)));
+
+		this->dampingN = std::pow(this->damping, (float)this->window);
+		this->Reset();
+	};
+
+	void Reset() {
+		this->samples.assign(this->window, 0.0f);
+		this->bins.assign(this->twiddles.size(), std::complex<float>(0, 0));
+		this->count = 0;
+	};
+
+	//S_k(n) = r e^(j2pik/N) S_k(n-1) + x(n) - r^N x(n-N), damped by r < 1 so rounding errors decay rather than accumulate
+	void Add(float sample) {
+		int pos = this->count % this->window;
+		float oldest = this->samples[pos];
+		this->samples[pos] = sample;
+		this->count++;
+
+		float delta = sample - this->dampingN * oldest;
+
+		for (size_t i = 0; i < this->bins.size(); i++)
+			this->bins[i] = this->twiddles[i] * this->bins[i] + delta;
+	};
+
+	//Estimates are only made once the window is full
+	bool IsReady() const {
+		return this->count >= this->window && this->bins.size() >= 3 && this->frameRate > 0;
+	};
+
+	//Beats per minute of the strongest frequency in range, 0 until ready
+	float GetBPM() const {
+		if (!this->IsReady())
+			return 0;
+
+		size_t peak = 0;
+		for (size_t i = 1; i < this->bins.size(); i++)
+			if (std::norm(this->bins[i]) > std::norm(this->bins[peak]))
+				peak = i;
+
+		//Parabolic interpolation of the peak, not possible at either end of the range
+		float offset = 0;
+		if (peak > 0 && peak < this->bins.size() - 1) {
+			float a = std::norm(this->bins[peak - 1]), b = std::norm(this->bins[peak]), c = std::norm(this->bins[peak + 1]);
+			float d = a - 2 * b + c;
+			offset = d != 0 ? 0.5f * (a - c) / d : 0;
+		}
+
+		float bin = this->firstBin + peak + offset;
+		return 60.0f * bin * this->frameRate / this->window;
+	};
+
+	float GetFrameRate() const {
+		return this->frameRate;
+	};
+private:
+	float damping = 0.99999f;
+
+	std::vector<std::complex<float>> twiddles, bins;
+	std::vector<float> samples;
+	float frameRate, dampingN;
+	int window, firstBin;
+	long long count = 0;
+};
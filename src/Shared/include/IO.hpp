@@ -2,57 +2,206 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace IO
 {
-	class Writer
+	//Results of one frame as written to a binary results file, the averages are those of Util::analyseData
+	struct Record
+	{
+		uint32_t frame;
+		float timestamp;
+		float x, y, magnitude, angle;
+	};
+
+	//Appends fixed size records to a binary results file as frames are analysed instead of keeping every line until the
+	//end. Records go into a preallocated buffer that a background thread swaps for an empty one and writes out whenever
+	//it fills or a second has passed, so memory stays bounded and a crash loses at most the last second. The tab
+	//separated file HeartPlot.m reads can still be exported from the records when the file is closed.
+	class RecordWriter
 	{
 	public:
-		Writer(const std::string out)
+		//path is the text export, the records go next to it with a .bin extension
+		RecordWriter(const std::string& path, bool export_text = true, size_t capacity = 4096)
 		{
-			this->file_path = out;
+			this->export_text = export_text;
+			this->capacity = capacity;
+			this->Open(path);
 		}
 
-		void AddLine(std::string s)
+		~RecordWriter()
 		{
-			this->lines.push_back(this->line + s);
-			this->line = "";
+			this->Close();
 		}
 
-		template<typename... Args>
-		void AddLine(std::string s, Args... args)
+		RecordWriter(const RecordWriter&) = delete;
+		RecordWriter& operator=(const RecordWriter&) = delete;
+
+		void Add(uint32_t frame, float x, float y, float magnitude, float angle)
 		{
-			this->line += s + '\t';
-			this->AddLine(args...);
+			std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - this->start;
+			Record record = { frame, elapsed.count(), x, y, magnitude, angle };
+
+			{
+				std::lock_guard<std::mutex> lock(this->lock);
+				this->active.push_back(record);
+
+				if (this->active.size() < this->capacity)
+					return;
+			}
+
+			this->ready.notify_one();
 		}
 
-		void NewFile(std::string file)
+		//Finishes the current file and starts another, e.g. for each pass over a looping input
+		void NewFile(const std::string& path)
 		{
-			this->file_path = file;
-			this->line = "";
-			std::string s = this->lines.at(0);
-			this->lines.clear();
-			this->lines.push_back(s);
+			this->Close();
+			this->Open(path);
 		}
 
-		void Write()
+		//Writes what is left and exports the text file if asked to
+		void Close()
 		{
-			std::ofstream out(this->file_path);
-			std::vector<std::string> rows;
+			if (!this->flusher.joinable())
+				return;
 
-			for (int i = 0; i < this->lines.size(); ++i)
 			{
-				out << this->lines[i];
-				if(i < this->lines.size() - 1)
-					out << '\n';
+				std::lock_guard<std::mutex> lock(this->lock);
+				this->stopping = true;
+			}
+
+			this->ready.notify_one();
+			this->flusher.join();
+
+			bool opened = this->file != NULL;
+
+			if (this->file)
+				std::fclose(this->file);
+
+			this->file = NULL;
+
+			if (this->export_text && opened)
+				ExportText(this->binary_path, this->text_path);
+		}
+
+		//False when the results file couldn't be created, records are then dropped
+		bool IsOpen() const
+		{
+			return this->file != NULL;
+		}
+
+		//Writes the records of a binary results file as the tab separated angle and magnitude of each frame
+		static bool ExportText(const std::string& binary_path, const std::string& text_path)
+		{
+			std::FILE * in = std::fopen(binary_path.c_str(), "rb");
+			char magic[8];
+			uint32_t version, record_size;
+
+			if (!in || std::fread(magic, 1, 8, in) != 8 || std::memcmp(magic, Magic(), 8) != 0
+				|| std::fread(&version, 4, 1, in) != 1 || std::fread(&record_size, 4, 1, in) != 1 || record_size != sizeof(Record)) {
+				std::cerr << "Not a results file: " << binary_path << std::endl;
+				if (in)
+					std::fclose(in);
+				return false;
 			}
 
-			out.close();
+			std::ofstream out(text_path);
+			out << "Angle 0-360\tMagnitude";
+
+			std::vector<Record> records(4096);
+			size_t count;
+
+			while ((count = std::fread(records.data(), sizeof(Record), records.size(), in)) > 0)
+				for (size_t i = 0; i < count; i++)
+					out << '\n' << std::to_string(records[i].angle) << '\t' << std::to_string(records[i].magnitude);
+
+			std::fclose(in);
+			return out.good();
+		}
+
+		static std::string BinaryPath(const std::string& path)
+		{
+			size_t dot = path.find_last_of('.');
+			size_t slash = path.find_last_of("/\\");
+
+			if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+				return path + ".bin";
+
+			return path.substr(0, dot) + ".bin";
 		}
 	private:
-		std::string file_path;
-		std::string line = "";
-		std::vector<std::string> lines;
+		std::string text_path, binary_path;
+		std::FILE * file = NULL;
+		bool export_text, stopping = false;
+		size_t capacity;
+		std::vector<Record> active;
+		std::chrono::steady_clock::time_point start;
+		std::thread flusher;
+		std::mutex lock;
+		std::condition_variable ready;
+
+		static const char * Magic()
+		{
+			return "BMRES01";
+		}
+
+		void Open(const std::string& path)
+		{
+			this->text_path = path;
+			this->binary_path = BinaryPath(path);
+			this->file = std::fopen(this->binary_path.c_str(), "wb");
+
+			if (this->file) {
+				uint32_t version = 1, record_size = sizeof(Record);
+				std::fwrite(Magic(), 1, 8, this->file);
+				std::fwrite(&version, 4, 1, this->file);
+				std::fwrite(&record_size, 4, 1, this->file);
+			}
+			else {
+				std::cerr << "Could not create results file: " << this->binary_path << std::endl;
+			}
+
+			this->active.clear();
+			this->active.reserve(this->capacity);
+			this->stopping = false;
+			this->start = std::chrono::steady_clock::now();
+			this->flusher = std::thread(&RecordWriter::Flush, this);
+		}
+
+		void Flush()
+		{
+			std::vector<Record> writing;
+			writing.reserve(this->capacity);
+
+			std::unique_lock<std::mutex> lock(this->lock);
+
+			while (true) {
+				this->ready.wait_for(lock, std::chrono::seconds(1), [this] { return this->stopping || this->active.size() >= this->capacity; });
+
+				//Hand the empty buffer to Add() and write the full one without holding the lock
+				std::swap(this->active, writing);
+				bool stop = this->stopping;
+				lock.unlock();
+
+				if (this->file && !writing.empty()) {
+					std::fwrite(writing.data(), sizeof(Record), writing.size(), this->file);
+					std::fflush(this->file);
+				}
+
+				writing.clear();
+
+				if (stop)
+					return;
+
+				lock.lock();
+			}
+		}
 	};
-	
 }
\ No newline at end of file
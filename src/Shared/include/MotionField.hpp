@@ -0,0 +1,160 @@
+#pragma once
+#include <cmath>
+#include <climits>
+#include <algorithm>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include <opencv2/opencv.hpp>
+
+//Motion vectors of a wB x hB block grid kept as separate arrays (structure of arrays) so each can be filled by a search,
+//read back from a device buffer or summed without touching the others. Block idx = x + y * wB has its top left corner at
+//(x * stepSize, y * stepSize) and matched the reference block displaced by (dx, dy) with error cost. Angle and magnitude
+//are derived from dx/dy only when first asked for after the field changed, searches never compute them.
+class MotionField {
+public:
+	MotionField() {};
+
+	MotionField(int wB, int hB, int blockSize, int stepSize) {
+		this->Resize(wB, hB, blockSize, stepSize);
+	};
+
+	MotionField(const MotionField&) = delete;
+	MotionField& operator=(const MotionField&) = delete;
+
+	//Arrays are only reallocated when the number of blocks changes, call whenever the block configuration does
+	void Resize(int wB, int hB, int blockSize, int stepSize) {
+		this->wB = wB;
+		this->hB = hB;
+		this->blockSize = blockSize;
+		this->stepSize = stepSize;
+
+		if (wB * hB != this->dx.Size()) {
+			int count = std::max(0, wB * hB);
+			this->dx.Allocate(count);
+			this->dy.Allocate(count);
+			this->cost.Allocate(count);
+			this->angle.Allocate(count);
+			this->magnitude.Allocate(count);
+		}
+
+		this->Clear();
+	};
+
+	//Every block stationary, as left by a search that found no candidate
+	void Clear() {
+		std::fill(this->dx.Data(), this->dx.Data() + this->GetCount(), 0);
+		std::fill(this->dy.Data(), this->dy.Data() + this->GetCount(), 0);
+		std::fill(this->cost.Data(), this->cost.Data() + this->GetCount(), INT_MAX);
+		this->Invalidate();
+	};
+
+	//Searches write blocks concurrently so they don't flag the derived arrays themselves, call once before or after writing
+	void Invalidate() {
+		this->derived = false;
+	};
+
+	inline void Set(int idx, int dx, int dy, int cost) {
+		this->dx[idx] = dx;
+		this->dy[idx] = dy;
+		this->cost[idx] = cost;
+	};
+
+	inline cv::Point GetOrigin(int idx) const {
+		return cv::Point((idx % this->wB) * this->stepSize, (idx / this->wB) * this->stepSize);
+	};
+
+	//Top left corner of the matched block in the reference frame
+	inline cv::Point GetRefPoint(int idx) const {
+		cv::Point origin = this->GetOrigin(idx);
+		return cv::Point(origin.x + this->dx[idx], origin.y + this->dy[idx]);
+	};
+
+	int * DX() { return this->dx.Data(); };
+	int * DY() { return this->dy.Data(); };
+	int * Cost() { return this->cost.Data(); };
+	const int * DX() const { return this->dx.Data(); };
+	const int * DY() const { return this->dy.Data(); };
+	const int * Cost() const { return this->cost.Data(); };
+
+	//Twice the angle between the vector and one of equal length pointing up the frame, in degrees
+	const float * GetAngles() const {
+		this->Derive();
+		return this->angle.Data();
+	};
+
+	//Length of each vector in pixels
+	const float * GetMagnitudes() const {
+		this->Derive();
+		return this->magnitude.Data();
+	};
+
+	int GetWB() const { return this->wB; };
+	int GetHB() const { return this->hB; };
+	int GetCount() const { return std::max(0, this->wB * this->hB); };
+	int GetBlockSize() const { return this->blockSize; };
+	int GetStepSize() const { return this->stepSize; };
+
+	//Copy into the interleaved arrays the engines used to fill, absolute reference points and (angle, magnitude)
+	void CopyTo(cv::Point * motionVectors, cv::Point2f * motionDetails) const {
+		const float * angles = this->GetAngles();
+		const float * magnitudes = this->GetMagnitudes();
+
+		for (int i = 0; i < this->GetCount(); i++) {
+			motionVectors[i] = this->GetRefPoint(i);
+			if (motionDetails != nullptr)
+				motionDetails[i] = cv::Point2f(angles[i], magnitudes[i]);
+		}
+	};
+private:
+	//Cache line aligned array that keeps its storage until the size changes
+	template<typename T>
+	class AlignedArray {
+	public:
+		AlignedArray() {};
+		~AlignedArray() { cv::fastFree(this->data); };
+
+		AlignedArray(const AlignedArray&) = delete;
+		AlignedArray& operator=(const AlignedArray&) = delete;
+
+		void Allocate(int count) {
+			cv::fastFree(this->data);
+			this->data = count > 0 ? static_cast<T *>(cv::fastMalloc(sizeof(T) * count)) : nullptr;
+			this->size = count;
+		};
+
+		int Size() const { return this->size; };
+		T * Data() const { return this->data; };
+		inline T& operator[](int i) const { return this->data[i]; };
+	private:
+		T * data = nullptr;
+		int size = 0;
+	};
+
+	AlignedArray<int> dx, dy, cost;
+	AlignedArray<float> angle, magnitude;
+	int wB = 0, hB = 0, blockSize = 0, stepSize = 0;
+	mutable bool derived = false;
+
+	static inline float Square(float x) {
+		return x * x;
+	};
+
+	//Same arithmetic the engines used inline so values match those written before the field existed
+	void Derive() const {
+		if (this->derived)
+			return;
+
+		for (int i = 0; i < this->GetCount(); i++) {
+			cv::Point origin = this->GetOrigin(i), ref = this->GetRefPoint(i);
+			float length = sqrt((float)(Square(ref.x - origin.x) + Square(ref.y - origin.y)));
+			float p0x = origin.x, p0y = origin.y - length;
+
+			this->magnitude[i] = length;
+			this->angle[i] = (2 * atan2(ref.y - p0y, ref.x - p0x)) * 180 / M_PI;
+		}
+
+		this->derived = true;
+	};
+};
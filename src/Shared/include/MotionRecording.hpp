@@ -0,0 +1,241 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include "MotionField.hpp"
+
+//Every motion field of a run so it can be analysed again without matching. A frame is stored as its block configuration
+//and the change of each dx and dy from the frame before (from zero after the configuration changed), all dx then all dy.
+//Changes are zigzag encoded so small negative ones stay small and written as varints, a zero is followed by the count
+//of zeros after it, so blocks that keep their vector between frames cost next to nothing.
+//
+//File: magic, version, ROI width, ROI height, frame time in ms (8 bytes) then per frame varints of the frame index, wB,
+//hB, block size, step size and the payload size in bytes followed by the payload.
+namespace MotionCoding {
+	static const char Magic[8] = { 'B', 'M', 'F', 'I', 'E', 'L', 'D', '1' };
+
+	inline void PutVarint(std::vector<uint8_t>& out, uint32_t value) {
+		while (value >= 0x80) {
+			out.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+
+		out.push_back((uint8_t)value);
+	}
+
+	//False when the varint runs past end
+	inline bool GetVarint(const uint8_t *& in, const uint8_t * end, uint32_t& value) {
+		value = 0;
+
+		for (int shift = 0; shift < 35 && in < end; shift += 7) {
+			uint8_t byte = *in++;
+			value |= (uint32_t)(byte & 0x7F) << shift;
+
+			if (!(byte & 0x80))
+				return true;
+		}
+
+		return false;
+	}
+
+	inline uint32_t ZigZag(int32_t value) {
+		return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+	}
+
+	inline int32_t UnZigZag(uint32_t value) {
+		return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+	}
+
+	//Appends the changes of current from previous
+	inline void Encode(std::vector<uint8_t>& out, const int * current, const int * previous, int count) {
+		for (int i = 0; i < count; ) {
+			uint32_t value = ZigZag(current[i] - previous[i]);
+			PutVarint(out, value);
+			i++;
+
+			if (value != 0)
+				continue;
+
+			uint32_t run = 0;
+			while (i < count && current[i] == previous[i]) {
+				run++;
+				i++;
+			}
+
+			PutVarint(out, run);
+		}
+	}
+
+	//Adds the changes back onto values, which holds the previous frame. False if the payload is short or too long
+	inline bool Decode(const uint8_t *& in, const uint8_t * end, int * values, int count) {
+		for (int i = 0; i < count; ) {
+			uint32_t value;
+			if (!GetVarint(in, end, value))
+				return false;
+
+			values[i++] += UnZigZag(value);
+
+			if (value != 0)
+				continue;
+
+			uint32_t run;
+			if (!GetVarint(in, end, run) || run > (uint32_t)(count - i))
+				return false;
+
+			i += run;
+		}
+
+		return true;
+	}
+}
+
+class MotionRecorder {
+public:
+	//width and height of the ROI the fields were matched in, frameTime in ms or 0 if unknown
+	MotionRecorder(const std::string& path, int width, int height, double frameTime)
+		: out(path, std::ios::binary | std::ios::trunc) {
+		if (!this->out.good()) {
+			std::cerr << "Could not create motion recording: " << path << std::endl;
+			return;
+		}
+
+		uint32_t header[3] = { 1, (uint32_t)width, (uint32_t)height };
+		this->out.write(MotionCoding::Magic, 8);
+		this->out.write((const char *)header, sizeof(header));
+		this->out.write((const char *)&frameTime, sizeof(frameTime));
+	};
+
+	void Add(int index, const MotionField& field) {
+		const int count = field.GetCount();
+
+		//Deltas are from zero after the block configuration changed
+		if (field.GetWB() != this->wB || field.GetHB() != this->hB || field.GetBlockSize() != this->blockSize || field.GetStepSize() != this->stepSize) {
+			this->wB = field.GetWB();
+			this->hB = field.GetHB();
+			this->blockSize = field.GetBlockSize();
+			this->stepSize = field.GetStepSize();
+			this->dx.assign(count, 0);
+			this->dy.assign(count, 0);
+		}
+
+		this->payload.clear();
+		MotionCoding::Encode(this->payload, field.DX(), this->dx.data(), count);
+		MotionCoding::Encode(this->payload, field.DY(), this->dy.data(), count);
+
+		this->frame.clear();
+		MotionCoding::PutVarint(this->frame, (uint32_t)std::max(0, index));
+		MotionCoding::PutVarint(this->frame, this->wB);
+		MotionCoding::PutVarint(this->frame, this->hB);
+		MotionCoding::PutVarint(this->frame, this->blockSize);
+		MotionCoding::PutVarint(this->frame, this->stepSize);
+		MotionCoding::PutVarint(this->frame, (uint32_t)this->payload.size());
+
+		this->out.write((const char *)this->frame.data(), this->frame.size());
+		this->out.write((const char *)this->payload.data(), this->payload.size());
+
+		std::copy(field.DX(), field.DX() + count, this->dx.begin());
+		std::copy(field.DY(), field.DY() + count, this->dy.begin());
+	};
+
+	bool IsOpened() {
+		return this->out.is_open() && this->out.good();
+	};
+private:
+	std::ofstream out;
+	std::vector<uint8_t> frame, payload;
+	std::vector<int> dx, dy;
+	int wB = -1, hB = -1, blockSize = -1, stepSize = -1;
+};
+
+//Reads a recording back a field at a time, fields come out as the matcher left them apart from cost, which is not kept
+class MotionReplay {
+public:
+	MotionReplay(const std::string& path) : in(path, std::ios::binary) {
+		char magic[8];
+		uint32_t header[3];
+
+		this->opened = this->in.read(magic, 8) && std::memcmp(magic, MotionCoding::Magic, 8) == 0
+			&& this->in.read((char *)header, sizeof(header)) && header[0] == 1
+			&& this->in.read((char *)&this->frame_time, sizeof(this->frame_time));
+
+		if (!this->opened) {
+			std::cerr << "Not a motion recording: " << path << std::endl;
+			return;
+		}
+
+		this->width = header[1];
+		this->height = header[2];
+	};
+
+	//Next field and the index of its frame, false at the end of the recording or if it is damaged
+	bool Next(MotionField& field, int& index) {
+		uint32_t values[6];
+
+		for (int i = 0; i < 6; i++)
+			if (!this->ReadVarint(values[i]))
+				return false;
+
+		index = (int)values[0];
+		int wB = values[1], hB = values[2], blockSize = values[3], stepSize = values[4];
+
+		this->payload.resize(values[5]);
+		if (!this->in.read((char *)this->payload.data(), this->payload.size()))
+			return false;
+
+		if (wB != field.GetWB() || hB != field.GetHB() || blockSize != field.GetBlockSize() || stepSize != field.GetStepSize())
+			field.Resize(wB, hB, blockSize, stepSize);
+
+		//Changes are from the previous field unless the configuration changed
+		if (wB * hB != (int)this->dx.size() || wB != this->wB || blockSize != this->blockSize || stepSize != this->stepSize) {
+			this->dx.assign(wB * hB, 0);
+			this->dy.assign(wB * hB, 0);
+			this->wB = wB;
+			this->blockSize = blockSize;
+			this->stepSize = stepSize;
+		}
+
+		const uint8_t * data = this->payload.data(), * end = data + this->payload.size();
+		if (!MotionCoding::Decode(data, end, this->dx.data(), wB * hB) || !MotionCoding::Decode(data, end, this->dy.data(), wB * hB))
+			return false;
+
+		std::copy(this->dx.begin(), this->dx.end(), field.DX());
+		std::copy(this->dy.begin(), this->dy.end(), field.DY());
+		std::fill(field.Cost(), field.Cost() + field.GetCount(), 0);
+		field.Invalidate();
+		return true;
+	};
+
+	bool IsOpened() { return this->opened; };
+	int GetWidth() { return this->width; };
+	int GetHeight() { return this->height; };
+	double GetFrameRate() { return this->frame_time > 0 ? 1000.0 / this->frame_time : 0; };
+private:
+	std::ifstream in;
+	std::vector<uint8_t> payload;
+	std::vector<int> dx, dy;
+	double frame_time = 0;
+	int width = 0, height = 0, wB = -1, blockSize = -1, stepSize = -1;
+	bool opened = false;
+
+	bool ReadVarint(uint32_t& value) {
+		value = 0;
+
+		for (int shift = 0; shift < 35; shift += 7) {
+			int byte = this->in.get();
+			if (byte == EOF)
+				return false;
+
+			value |= (uint32_t)(byte & 0x7F) << shift;
+
+			if (!(byte & 0x80))
+				return true;
+		}
+
+		return false;
+	};
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#include <opencv2/opencv.hpp>
+
+//Command line options shared by both applications. Unknown arguments are skipped so the parallel application can pass
+//the same argv to CLContext for its platform and device options.
+class Options {
+public:
+	Options(int argc, char **argv) {
+		InitialiseArguments(argc, argv);
+	};
+
+	void InitialiseArguments(int argc, char **argv) {
+		for (int i = 1; i < argc; i++)
+		{
+			if (strcmp(argv[i], "--headless") == 0)
+			{
+				headless = true;
+			}
+			else if ((strcmp(argv[i], "--input") == 0) && (i < (argc - 1)))
+			{
+				input = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--output") == 0) && (i < (argc - 1)))
+			{
+				output = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--roi") == 0) && (i < (argc - 1)))
+			{
+				int x, y, w, h;
+				if (sscanf(argv[++i], "%d,%d,%d,%d", &x, &y, &w, &h) == 4)
+					roi = cv::Rect(x, y, w, h);
+				else
+					std::cerr << "Ignoring --roi " << argv[i] << ", expected x,y,width,height" << std::endl;
+			}
+			else if ((strcmp(argv[i], "--block") == 0) && (i < (argc - 1)))
+			{
+				blockSize = atoi(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--engine") == 0) && (i < (argc - 1)))
+			{
+				engine = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--pairs") == 0) && (i < (argc - 1)))
+			{
+				pairs = atoi(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--batch") == 0) && (i < (argc - 1)))
+			{
+				batch = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--workers") == 0) && (i < (argc - 1)))
+			{
+				workers = atoi(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--decoders") == 0) && (i < (argc - 1)))
+			{
+				decoders = atoi(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--decode-threads") == 0) && (i < (argc - 1)))
+			{
+				decodeThreads = atoi(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--frame-time") == 0) && (i < (argc - 1)))
+			{
+				frameTime = (float)atof(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--record") == 0) && (i < (argc - 1)))
+			{
+				record = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--replay") == 0) && (i < (argc - 1)))
+			{
+				replay = argv[++i];
+			}
+			else if (strcmp(argv[i], "--no-tsv") == 0)
+			{
+				tsv = false;
+			}
+			else if (strcmp(argv[i], "--latency") == 0)
+			{
+				latency = true;
+			}
+			else if ((strcmp(argv[i], "--cache") == 0) && (i < (argc - 1)))
+			{
+				cacheMB = atoi(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--convert") == 0) && (i < (argc - 1)))
+			{
+				convert = argv[++i];
+			}
+			else if (strcmp(argv[i], "--help") == 0)
+			{
+				PrintArgumentsHelp();
+			}
+		}
+	};
+
+	void PrintArgumentsHelp() {
+		std::cerr << "USAGE:" << std::endl;
+		std::cerr << "\t--headless : Process the input once without windows and print the total frame rate." << std::endl;
+		std::cerr << "\t--input <path> : Video file to process." << std::endl;
+		std::cerr << "\t--output <path> : Results file, defaults to a timestamped file in results/raw." << std::endl;
+		std::cerr << "\t--roi <x,y,width,height> : Region to process, otherwise selected interactively or the whole frame when headless." << std::endl;
+		std::cerr << "\t--block <size> : Block size, must divide the ROI width and height." << std::endl;
+		std::cerr << "\t--engine <name> : Matching engine, see the application for the names it accepts." << std::endl;
+		std::cerr << "\t--pairs <count> : Frame pairs matched at once with --headless, 0 for one per core." << std::endl;
+		std::cerr << "\t--batch <directory|manifest> : Process every study of a directory or listed in a .txt manifest, --output is the results directory." << std::endl;
+		std::cerr << "\t--workers <count> : Studies processed at once with --batch, defaults to one per core." << std::endl;
+		std::cerr << "\t--decoders <count> : DICOM frames decoded ahead at once across every study of --batch, which bounds decode memory whatever the number of workers. Defaults to 4 per worker." << std::endl;
+		std::cerr << "\t--decode-threads <count> : Threads decoding the frames of a JPEG DICOM ahead of the matching with --batch." << std::endl;
+		std::cerr << "\t--frame-time <ms> : FrameTime of the DICOM the input was converted from, for the heart rate. Defaults to the rate of the input." << std::endl;
+		std::cerr << "\t--record <path> : Also write every motion field to a recording, which --replay analyses again without matching." << std::endl;
+		std::cerr << "\t--replay <path> : Analyse and draw the motion fields of a recording instead of matching an input (Sequential only)." << std::endl;
+		std::cerr << "\t--no-tsv : Only write the binary results (.bin), not the tab separated export of them that HeartPlot.m reads." << std::endl;
+		std::cerr << "\t--latency : Time every stage a frame goes through and print p50/p95/p99/max of each every 10s and at exit." << std::endl;
+		std::cerr << "\t--cache <MB> : Memory for keeping the frames of a looping input after the first pass, 0 decodes every pass. Defaults to 512." << std::endl;
+		std::cerr << "\t--convert <path.stack> : Write the ROI of every frame of --input as gray to a frame stack, which --batch reads like a video." << std::endl;
+		std::cerr << "\t--help : Print Arguments Help." << std::endl;
+	};
+
+	bool HasROI() const {
+		return roi.area() > 0;
+	};
+
+	bool headless = false, tsv = true, latency = false;
+	std::string input, output, engine, batch, convert, record, replay;
+	cv::Rect roi;
+	int blockSize = 0, pairs = 1, workers = 0, decoders = 0, decodeThreads = 2, cacheMB = 512;
+	float frameTime = 0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+//Bounded lock-free queue between exactly one producer thread and one consumer thread. Slots live in a ring of a power of
+//two size, the producer only writes tail and the consumer only writes head so each index is published with a single
+//release store. Push and Pop wait for space or data by spinning, then yielding, then sleeping briefly so a stalled stage
+//(e.g. a paused display) doesn't hold a core. Close() may be called from any thread and wakes both sides.
+template<typename T>
+class SPSCQueue {
+public:
+	SPSCQueue(size_t capacity = 8) {
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+
+		this->slots.resize(size);
+		this->mask = size - 1;
+	};
+
+	SPSCQueue(const SPSCQueue&) = delete;
+	SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+	//Producer only, false if the queue is full
+	bool TryPush(const T& value) {
+		const size_t tail = this->tail.load(std::memory_order_relaxed);
+
+		if (tail - this->head.load(std::memory_order_acquire) > this->mask)
+			return false;
+
+		this->slots[tail & this->mask] = value;
+		this->tail.store(tail + 1, std::memory_order_release);
+		return true;
+	};
+
+	//Consumer only, false if the queue is empty
+	bool TryPop(T& value) {
+		const size_t head = this->head.load(std::memory_order_relaxed);
+
+		if (head == this->tail.load(std::memory_order_acquire))
+			return false;
+
+		value = this->slots[head & this->mask];
+		this->head.store(head + 1, std::memory_order_release);
+		return true;
+	};
+
+	//Producer only, waits for space and returns false once the queue is closed
+	bool Push(const T& value) {
+		for (int attempt = 0; !this->closed.load(std::memory_order_acquire); attempt++) {
+			if (this->TryPush(value))
+				return true;
+
+			Backoff(attempt);
+		}
+
+		return false;
+	};
+
+	//Consumer only, waits for a value and returns false once the queue is closed and drained
+	bool Pop(T& value) {
+		for (int attempt = 0; ; attempt++) {
+			if (this->TryPop(value))
+				return true;
+
+			//Values pushed before Close() are still delivered
+			if (this->closed.load(std::memory_order_acquire))
+				return this->TryPop(value);
+
+			Backoff(attempt);
+		}
+	};
+
+	void Close() {
+		this->closed.store(true, std::memory_order_release);
+	};
+
+	bool IsClosed() const {
+		return this->closed.load(std::memory_order_acquire);
+	};
+
+	size_t GetCapacity() const {
+		return this->mask + 1;
+	};
+private:
+	std::vector<T> slots;
+	size_t mask;
+
+	//Padded onto separate cache lines so the producer and consumer don't invalidate each other's index on every operation.
+	//Padding rather than alignas as C++11 new doesn't honour alignment beyond that of max_align_t
+	char head_padding[64];
+	std::atomic<size_t> head{ 0 };
+	char tail_padding[64];
+	std::atomic<size_t> tail{ 0 };
+	char closed_padding[64];
+	std::atomic<bool> closed{ false };
+
+	static void Backoff(int attempt) {
+		if (attempt < 64)
+			return;
+		else if (attempt < 128)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+	};
+};
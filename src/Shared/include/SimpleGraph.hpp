@@ -1,8 +1,19 @@
+#pragma once
 #include <string>
+#include <vector>
+#include <deque>
+#include <utility>
 #include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui.hpp>
 
+//Line graph of the last count values scaled to their range. Values are kept in a ring and the lines are drawn on a layer
+//of their own, which scrolls left by one point once the graph is full, so adding a value only draws its own segment.
+//The range is the min/max of the window kept in two monotonic queues, and only when it changes are the axis labels and
+//every line drawn again.
 class SimpleGraph
 {
 public:
@@ -23,34 +34,72 @@ public:
 
 	void InitialiseCanvas()
 	{
-		this->canvas = cv::Mat(cv::Size(this->width, this->height), CV_8UC3);
+		this->canvas = cv::Mat::zeros(cv::Size(this->width, this->height), CV_8UC3);
 		this->DrawAxis();
+		this->canvas.copyTo(this->background);
+
+		this->min_x = 0;
+		this->max_x = this->max_data_points;
+		this->x_gap = (this->x_end.x - this->x_start.x) / this->max_data_points;
+		this->y_gap = this->y_end.y - this->y_start.y;
+
+		//Lines are 2 pixels wide so the layer reaches past the top and bottom points
+		this->plot_area = cv::Rect(this->x_start.x, this->y_start.y - 2, this->x_end.x - this->x_start.x, this->y_gap + 5) & cv::Rect(0, 0, this->width, this->height);
+		this->plot = cv::Mat::zeros(this->plot_area.size(), CV_8UC3);
+
+		this->values.assign(this->max_data_points, 0);
+		this->Reset();
 	}
 
+	//Draws the labels for the current range and every line again
 	void Invalidate() {
 		this->canvas.setTo(0);
 		this->DrawAxis();
 		this->DrawLabels();
+		this->canvas.copyTo(this->background);
+
+		this->coordinates.resize(this->count);
+		for (int i = 0; i < this->count; ++i)
+			this->coordinates[i] = this->GetPlotPoint(i);
+
+		this->plot.setTo(0);
 		this->DrawLines(this->coordinates, this->pen);
 		//this->DrawBeats();
 	}
 
 	void AddData(float datapoint)
 	{
-		this->data_points.push_back(datapoint);
+		bool full = this->count == this->max_data_points;
+		this->Push(datapoint);
+
+		//Everything moves when the range does, otherwise the lines so far stay where they are
+		if (!this->scaled || this->minima.front().second != this->min_y || this->maxima.front().second != this->max_y) {
+			this->min_y = this->minima.front().second;
+			this->max_y = this->maxima.front().second;
+			this->scaled = true;
+			this->Invalidate();
+		}
+		else {
+			if (full)
+				this->Scroll();
 
-		if (this->data_points.size() > this->max_data_points) {
-			this->data_points.erase(this->data_points.begin(), this->data_points.begin() + this->data_points.size() - this->max_data_points);
+			if (this->count >= 2)
+				cv::line(this->plot, this->GetPlotPoint(this->count - 2), this->GetPlotPoint(this->count - 1), this->pen, 2, 8, 0);
 		}
 
-		this->GetMinMax();
-		this->NormaliseData();
-		this->ConvertNormalisedToPoints();
-		this->Invalidate();
+		//Lines are the brightest colour on the canvas, so the brighter of the two layers lays them over the labels
+		this->background.copyTo(this->canvas);
+		cv::Mat area = this->canvas(this->plot_area);
+		cv::max(area, this->plot, area);
 	}
 
+	//Forgets the values, the graph is drawn again from the next one
 	void Reset() {
-		this->data_points.clear();
+		this->count = 0;
+		this->added = 0;
+		this->minima.clear();
+		this->maxima.clear();
+		this->scaled = false;
 	}
 
 	void Show()
@@ -63,14 +112,79 @@ public:
 		cv::putText(this->canvas, label, cv::Point(20, this->height - 20), this->font_face, this->font_scale, this->pen);
 	}
 private:
-	cv::Mat canvas;
-	std::vector<float> data_points, normalised_points;
+	//canvas is what is shown, background holds the axes and labels and plot the lines of plot_area
+	cv::Mat canvas, background, plot;
+	cv::Rect plot_area;
+
+	//Ring of the last count values, the oldest at (added - count) % max_data_points
+	std::vector<float> values;
+	int count = 0;
+	long long added = 0;
+
+	//Indices and values of the window whose min/max is at the front, each value is queued and dropped once
+	std::deque<std::pair<long long, float>> minima, maxima;
+	bool scaled = false;
+
 	std::vector<cv::Point> coordinates;
-	int max_data_points, width, height, padding, font_face, intermediate_labels_count;
+	int max_data_points, width, height, padding, font_face, intermediate_labels_count, x_gap, y_gap;
 	float min_x, min_y, max_x, max_y, font_scale, baseline;
 	cv::Point y_start, x_start, y_end, x_end;
 	cv::Scalar axis_colour, pen, eraser;
 
+	void Push(float value) {
+		long long index = this->added++;
+		this->values[index % this->max_data_points] = value;
+		this->count = std::min(this->count + 1, this->max_data_points);
+
+		while (!this->minima.empty() && this->minima.back().second >= value)
+			this->minima.pop_back();
+
+		while (!this->maxima.empty() && this->maxima.back().second <= value)
+			this->maxima.pop_back();
+
+		this->minima.push_back(std::make_pair(index, value));
+		this->maxima.push_back(std::make_pair(index, value));
+
+		//Values that have left the window
+		long long oldest = this->added - this->count;
+
+		while (this->minima.front().first < oldest)
+			this->minima.pop_front();
+
+		while (this->maxima.front().first < oldest)
+			this->maxima.pop_front();
+	}
+
+	//i-th value of the window, 0 being the oldest
+	float GetValue(int i) {
+		return this->values[(this->added - this->count + i) % this->max_data_points];
+	}
+
+	float GetNormalised(int i) {
+		float range = this->max_y - this->min_y;
+		return range > 0 ? (this->GetValue(i) - this->min_y) / range : 0.5f;
+	}
+
+	//Position of the i-th value on the line layer
+	cv::Point GetPlotPoint(int i) {
+		int x = this->x_start.x + (i * this->x_gap) + 1;
+		int y = this->y_start.y + this->GetNormalised(i) * this->y_gap;
+
+		return cv::Point(x - this->plot_area.x, y - this->plot_area.y);
+	}
+
+	//Moves the lines one value to the left, the oldest segment falls off the edge
+	void Scroll() {
+		const size_t shift = (size_t)std::min(this->x_gap, this->plot.cols) * this->plot.elemSize();
+		const size_t row = (size_t)this->plot.cols * this->plot.elemSize();
+
+		for (int y = 0; y < this->plot.rows; y++) {
+			uchar * p = this->plot.ptr<uchar>(y);
+			std::memmove(p, p + shift, row - shift);
+			std::memset(p + row - shift, 0, shift);
+		}
+	}
+
 	void DrawAxis()
 	{
 		this->x_start = cv::Point(0 + this->padding, this->height / 2);
@@ -82,15 +196,16 @@ private:
 		this->DrawLine(this->y_start, this->y_end, this->axis_colour);
 	}
 
-	void DrawLine(cv::Point p1, cv::Point p2, cv::Scalar& colour, int thickness = 1, int line_type = 8, int shift = 0)
+	void DrawLine(cv::Point p1, cv::Point p2, const cv::Scalar& colour, int thickness = 1, int line_type = 8, int shift = 0)
 	{
 		cv::line(this->canvas, p1, p2, colour, thickness, line_type, shift);
 	}
 
-	void DrawLines(std::vector<cv::Point> p, cv::Scalar& colour, int thickness = 2, int line_type = 8, int shift = 0)
+	//Lines between consecutive points of the line layer
+	void DrawLines(const std::vector<cv::Point>& p, const cv::Scalar& colour, int thickness = 2, int line_type = 8, int shift = 0)
 	{
-		for (int i = 0; i < p.size() - 1; ++i) {
-			cv::line(this->canvas, p.at(i), p.at(i + 1), colour, thickness, line_type, shift);
+		for (size_t i = 0; i + 1 < p.size(); ++i) {
+			cv::line(this->plot, p[i], p[i + 1], colour, thickness, line_type, shift);
 		}
 	}
 
@@ -103,8 +218,8 @@ private:
 		float peak = 0, valley = 1;
 		int peak_pos = 0, valley_pos = 0;
 
-		for (int i = 0; i < this->normalised_points.size() - 1; ++i) {
-			float value = this->normalised_points.at(i), next = this->normalised_points.at(i + 1);
+		for (int i = 0; i + 1 < this->count; ++i) {
+			float value = this->GetNormalised(i), next = this->GetNormalised(i + 1);
 
 			if (value > next && value > peak && this->PercentageDifference(value, peak) > 0.10) {
 				peak = value;
@@ -117,11 +232,8 @@ private:
 			}
 		}
 
-		int x_gap = (this->x_end.x - this->x_start.x) / this->max_data_points;
-		int y_gap = (this->y_end.y - this->y_start.y);
-
-		int p_pos_x = this->x_start.x + (peak_pos * x_gap) + 1;
-		int v_pos_x = this->x_start.x + (valley_pos * x_gap) + 1;
+		int p_pos_x = this->x_start.x + (peak_pos * this->x_gap) + 1;
+		int v_pos_x = this->x_start.x + (valley_pos * this->x_gap) + 1;
 
 		this->DrawLine(cv::Point(v_pos_x, this->padding), cv::Point(v_pos_x, this->height / 2), cv::Scalar(0, 0, 255));
 		this->DrawLine(cv::Point(p_pos_x, this->height / 2), cv::Point(p_pos_x, this->height - this->padding), cv::Scalar(0, 255, 255));
@@ -130,10 +242,10 @@ private:
 	void DrawBeats() {
 		std::vector<int> beat_start_positions, beat_end_positions;
 
-		for (int i = 1; i < this->normalised_points.size() - 1; ++i) {
-			float prev = this->normalised_points.at(i - 1),
-				value = this->normalised_points.at(i),
-				next = this->normalised_points.at(i + 1);
+		for (int i = 1; i + 1 < this->count; ++i) {
+			float prev = this->GetNormalised(i - 1),
+				value = this->GetNormalised(i),
+				next = this->GetNormalised(i + 1);
 			double thresh = 0.02;
 			if (value > 0.5 - thresh && value < 0.5 + thresh) {
 				if (prev > value && value > next)
@@ -144,15 +256,13 @@ private:
 			}
 		}
 
-		int x_gap = (this->x_end.x - this->x_start.x) / this->max_data_points;
-
 		for (int i = 0; i < beat_start_positions.size(); ++i) {
-			int pos_x = this->x_start.x + (beat_start_positions.at(i) * x_gap) + 1;
+			int pos_x = this->x_start.x + (beat_start_positions.at(i) * this->x_gap) + 1;
 			this->DrawLine(cv::Point(pos_x, this->padding), cv::Point(pos_x, this->height - this->padding), cv::Scalar(0, 0, 255));
 		}
 
 		for (int i = 0; i < beat_end_positions.size(); ++i) {
-			int pos_x = this->x_start.x + (beat_end_positions.at(i) * x_gap) + 1;
+			int pos_x = this->x_start.x + (beat_end_positions.at(i) * this->x_gap) + 1;
 			this->DrawLine(cv::Point(pos_x, this->padding), cv::Point(pos_x, this->height - this->padding), cv::Scalar(0, 255, 255));
 		}
 	}
@@ -227,35 +337,4 @@ private:
 	cv::Size GetTextSize(std::string label) {
 		return cv::getTextSize(label, this->font_face, this->font_scale, 1, 0);
 	}
-
-	void GetMinMax() {
-		this->min_x = 0;
-		this->max_x = this->max_data_points;
-		this->min_y = *std::min_element(std::begin(this->data_points), std::end(this->data_points));
-		this->max_y = *std::max_element(std::begin(this->data_points), std::end(this->data_points));
-	}
-
-	void NormaliseData() {
-		this->normalised_points = std::vector<float>(this->data_points.size());
-
-		for (int i = 0; i < this->data_points.size(); ++i) {
-			this->normalised_points.at(i) = (this->data_points.at(i) - this->min_y) / (this->max_y - this->min_y);
-		}
-	}
-
-	void ConvertNormalisedToPoints() {
-		int x_gap = round((this->x_end.x - this->x_start.x) / this->max_data_points);
-		int y_gap = round((this->y_end.y - this->y_start.y));
-
-
-		this->coordinates = std::vector<cv::Point>(this->normalised_points.size());
-
-		for (int i = 0; i < normalised_points.size(); ++i) {
-			int x = 0, y = 0;
-			x = this->x_start.x + (i * x_gap) + 1;
-			y = this->y_start.y + normalised_points.at(i) * y_gap;
-
-			this->coordinates.at(i) = cv::Point(x, y);
-		}
-	}
 };
@@ -0,0 +1,171 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+//Fixed size pool of worker threads with a work stealing ParallelFor. Each thread owns a deque that is seeded with a
+//contiguous range of task indices, it pops from the front of its own deque and when that runs dry steals from the back
+//of the others, so uneven task costs are balanced without a shared queue. The calling thread takes part as worker 0.
+class ThreadPool {
+public:
+	ThreadPool(unsigned int threads = std::thread::hardware_concurrency()) {
+		this->thread_count = std::max(1u, threads);
+
+		for (unsigned int i = 0; i < this->thread_count; i++)
+			this->queues.emplace_back(new TaskQueue());
+
+		for (unsigned int i = 1; i < this->thread_count; i++)
+			this->workers.emplace_back(&ThreadPool::Worker, this, i);
+	};
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(this->state_lock);
+			this->stop = true;
+		}
+
+		this->start_cv.notify_all();
+
+		for (size_t i = 0; i < this->workers.size(); i++)
+			this->workers[i].join();
+	};
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//Run task(i) for every i in [0, count) and return once all have finished, the first exception thrown by a task is rethrown
+	void ParallelFor(int count, const std::function<void(int)>& task) {
+		if (count <= 0)
+			return;
+
+		//One batch at a time, the queues and job are shared by every caller
+		std::lock_guard<std::mutex> batch(this->batch_lock);
+
+		if (this->thread_count == 1) {
+			for (int i = 0; i < count; i++)
+				task(i);
+			return;
+		}
+
+		this->job = &task;
+		this->error = nullptr;
+		this->remaining = count;
+
+		//Seed each queue with a contiguous range so neighbouring tasks start on the same thread
+		for (unsigned int q = 0; q < this->thread_count; q++) {
+			int begin = (int)((long long)count * q / this->thread_count);
+			int end = (int)((long long)count * (q + 1) / this->thread_count);
+
+			std::lock_guard<std::mutex> lock(this->queues[q]->lock);
+			for (int i = begin; i < end; i++)
+				this->queues[q]->tasks.push_back(i);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->state_lock);
+			this->generation++;
+		}
+
+		this->start_cv.notify_all();
+		this->RunTasks(0);
+
+		std::unique_lock<std::mutex> lock(this->state_lock);
+		this->done_cv.wait(lock, [this] { return this->remaining == 0; });
+		this->job = nullptr;
+
+		if (this->error)
+			std::rethrow_exception(this->error);
+	};
+
+	unsigned int GetThreadCount() {
+		return this->thread_count;
+	};
+private:
+	struct TaskQueue {
+		std::mutex lock;
+		std::deque<int> tasks;
+	};
+
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> workers;
+	const std::function<void(int)> * job = nullptr;
+	std::exception_ptr error;
+	std::mutex batch_lock, state_lock;
+	std::condition_variable start_cv, done_cv;
+	std::atomic<int> remaining{ 0 };
+	unsigned int thread_count, generation = 0;
+	bool stop = false;
+
+	void Worker(unsigned int id) {
+		unsigned int seen = 0;
+
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(this->state_lock);
+				this->start_cv.wait(lock, [this, seen] { return this->stop || this->generation != seen; });
+
+				if (this->stop)
+					return;
+
+				seen = this->generation;
+			}
+
+			this->RunTasks(id);
+		}
+	};
+
+	void RunTasks(unsigned int id) {
+		int task;
+
+		while (this->Pop(id, task) || this->Steal(id, task)) {
+			try {
+				(*this->job)(task);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(this->state_lock);
+				if (!this->error)
+					this->error = std::current_exception();
+			}
+
+			if (--this->remaining == 0) {
+				std::lock_guard<std::mutex> lock(this->state_lock);
+				this->done_cv.notify_all();
+			}
+		}
+	};
+
+	bool Pop(unsigned int id, int& task) {
+		TaskQueue& q = *this->queues[id];
+		std::lock_guard<std::mutex> lock(q.lock);
+
+		if (q.tasks.empty())
+			return false;
+
+		task = q.tasks.front();
+		q.tasks.pop_front();
+		return true;
+	};
+
+	//Take from the back of another thread's queue, furthest from the work it is about to do
+	bool Steal(unsigned int id, int& task) {
+		for (unsigned int i = 1; i < this->thread_count; i++) {
+			TaskQueue& q = *this->queues[(id + i) % this->thread_count];
+			std::lock_guard<std::mutex> lock(q.lock);
+
+			if (!q.tasks.empty()) {
+				task = q.tasks.back();
+				q.tasks.pop_back();
+				return true;
+			}
+		}
+
+		return false;
+	};
+};
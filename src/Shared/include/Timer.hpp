@@ -1,28 +1,46 @@
+#pragma once
 #include <iostream>
+#include <iomanip>
 #include <vector>
+#include <string>
 #include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
 
 #define NANO 1000000000.0
 
 class Timer {
 public:
+	//The last maxSamp intervals are kept in a ring, the FPS is their count over their sum
 	Timer(int maxSamp = 50) {
-		this->maxSamples = maxSamp;
+		this->maxSamples = std::max(1, maxSamp);
+		this->timestamps.reserve(this->maxSamples);
 	};
 
 	void tic() {
-		this->startTime = std::chrono::high_resolution_clock::now();
+		this->startTime = std::chrono::steady_clock::now();
 	};
 
 	void toc() {
-		this->timestamps.push_back(this->getElapsed());
-		if (this->timestamps.size() > maxSamples) {
-			this->timestamps.erase(this->timestamps.begin(), this->timestamps.begin() + this->timestamps.size() - maxSamples);
+		long long int elapsed = this->getElapsed();
+
+		if (this->timestamps.size() < this->maxSamples) {
+			this->timestamps.push_back(elapsed);
+		}
+		else {
+			this->sum -= this->timestamps[this->next];
+			this->timestamps[this->next] = elapsed;
+			this->next = (this->next + 1) % this->maxSamples;
 		}
+
+		this->sum += elapsed;
 	};
 
 	long long int stop() {
-		timestamps.clear();
+		this->timestamps.clear();
+		this->next = 0;
+		this->sum = 0;
 		return this->getElapsed();
 	};
 
@@ -32,19 +50,147 @@ public:
 	};
 
 	float elapsedSum() {
-		long long int sum = 0;
-
-		for (std::vector<long long int>::iterator it = this->timestamps.begin(); it != this->timestamps.end(); ++it)
-			sum += *it;
-
-		return (float) sum / NANO;
+		return (float) this->sum / NANO;
 	};
 
 	long long int getElapsed() {
-		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
 	};
 private:
 	std::chrono::steady_clock::time_point startTime;
 	std::vector<long long int> timestamps;
-	unsigned int maxSamples;
-};
\ No newline at end of file
+	unsigned int maxSamples, next = 0;
+	long long int sum = 0;
+};
+
+//Durations in nanoseconds counted into log-linear buckets: 16 linear buckets for every power of two, so any value is
+//within 1/16 of its bucket and memory is fixed however many are recorded. The counts are atomics so several threads
+//may record at once, e.g. concurrent match stages, and any thread may report while they do.
+class LatencyHistogram {
+public:
+	static const int SUB_BITS = 4;
+	static const int SUB_COUNT = 1 << SUB_BITS;
+	static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+	LatencyHistogram() {
+		this->Reset();
+	};
+
+	void Record(long long int ns) {
+		uint64_t value = ns > 0 ? (uint64_t)ns : 0;
+		this->counts[Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+		this->count.fetch_add(1, std::memory_order_relaxed);
+
+		uint64_t max = this->max.load(std::memory_order_relaxed);
+		while (value > max && !this->max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+	};
+
+	void Reset() {
+		for (int i = 0; i < BUCKETS; i++)
+			this->counts[i].store(0, std::memory_order_relaxed);
+
+		this->count.store(0, std::memory_order_relaxed);
+		this->max.store(0, std::memory_order_relaxed);
+	};
+
+	uint64_t GetCount() const {
+		return this->count.load(std::memory_order_relaxed);
+	};
+
+	uint64_t GetMax() const {
+		return this->max.load(std::memory_order_relaxed);
+	};
+
+	//Middle of the bucket holding the given fraction (0-1) of values, never more than the largest value
+	uint64_t GetPercentile(double fraction) const {
+		uint64_t total = this->GetCount(), seen = 0;
+		uint64_t rank = (uint64_t)std::max(1.0, fraction * total + 0.5);
+
+		for (int i = 0; i < BUCKETS && total > 0; i++) {
+			seen += this->counts[i].load(std::memory_order_relaxed);
+
+			if (seen >= rank)
+				return std::min(Middle(i), this->GetMax());
+		}
+
+		return this->GetMax();
+	};
+
+	static int Bucket(uint64_t value) {
+		if (value < SUB_COUNT)
+			return (int)value;
+
+		int msb = 63;
+		while (!(value >> msb))
+			msb--;
+
+		int shift = msb - SUB_BITS;
+		return (shift + 1) * SUB_COUNT + (int)((value >> shift) - SUB_COUNT);
+	};
+
+	static uint64_t Middle(int bucket) {
+		if (bucket < SUB_COUNT)
+			return bucket;
+
+		int shift = bucket / SUB_COUNT - 1;
+		uint64_t lower = (uint64_t)(bucket % SUB_COUNT + SUB_COUNT) << shift;
+		return lower + ((1ull << shift) >> 1);
+	};
+private:
+	std::atomic<uint64_t> counts[BUCKETS];
+	std::atomic<uint64_t> count, max;
+};
+
+//Records the time from construction to destruction, or nothing without a histogram
+class ScopedTimer {
+public:
+	ScopedTimer(LatencyHistogram * histogram) {
+		this->histogram = histogram;
+
+		if (histogram)
+			this->start = std::chrono::steady_clock::now();
+	};
+
+	~ScopedTimer() {
+		if (this->histogram)
+			this->histogram->Record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start).count());
+	};
+private:
+	LatencyHistogram * histogram;
+	std::chrono::steady_clock::time_point start;
+};
+
+//Latency of every stage a frame goes through, each recorded by the thread running that stage
+class StageTimers {
+public:
+	enum Stage { Decode, Gray, Match, Upload, Kernel, Readback, Analyse, Draw, STAGE_COUNT };
+
+	LatencyHistogram * operator[](Stage stage) {
+		return &this->histograms[stage];
+	};
+
+	//p50/p95/p99/max in milliseconds of every stage that has recorded anything
+	void Report(std::ostream& out) const {
+		static const char * names[STAGE_COUNT] = { "decode", "gray", "match", "upload", "kernel", "readback", "analyse", "draw" };
+		std::ios::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+
+		out << std::left << std::setw(10) << "stage" << std::right << std::setw(10) << "count" << std::setw(10) << "p50 ms"
+			<< std::setw(10) << "p95 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::endl;
+
+		for (int i = 0; i < STAGE_COUNT; i++) {
+			const LatencyHistogram& histogram = this->histograms[i];
+			if (histogram.GetCount() == 0)
+				continue;
+
+			out << std::left << std::setw(10) << names[i] << std::right << std::setw(10) << histogram.GetCount() << std::fixed << std::setprecision(3)
+				<< std::setw(10) << histogram.GetPercentile(0.50) / 1e6 << std::setw(10) << histogram.GetPercentile(0.95) / 1e6
+				<< std::setw(10) << histogram.GetPercentile(0.99) / 1e6 << std::setw(10) << histogram.GetMax() / 1e6 << std::endl;
+		}
+
+		out.flags(flags);
+		out.precision(precision);
+	};
+private:
+	LatencyHistogram histograms[STAGE_COUNT];
+};
@@ -1,7 +1,10 @@
-﻿#include <string>
+﻿#pragma once
+#include <string>
 #include <vector>
 #include <algorithm>
 
+#include "MotionField.hpp"
+
 namespace Util {
 	void getFactors(std::vector<int> & factors, int number) {
 		factors.push_back(1);
@@ -40,6 +43,29 @@ namespace Util {
 		return f.rbegin()[1];
 	}
 
+	//Blocks along each axis with a top left corner on a multiple of stepSize that lie fully inside the frame. Equal to
+	//(width / stepSize) - 1 when blockSize is twice stepSize, other sizes (odd ones) would otherwise run past the edge.
+	cv::Size getBlockGrid(int width, int height, int blockSize, int stepSize) {
+		return cv::Size(std::max(0, (width - blockSize) / stepSize + 1), std::max(0, (height - blockSize) / stepSize + 1));
+	}
+
+	//8 bit single channel copy of a decoded frame, which may be BGR (video), BGRA or already gray (DICOM) and 16 bit
+	void toGray(const cv::Mat& in, cv::Mat& out) {
+		cv::Mat scaled;
+
+		if (in.depth() == CV_16U)
+			in.convertTo(scaled, CV_8U, 1.0 / 256.0);
+		else
+			scaled = in;
+
+		if (scaled.channels() == 3)
+			cv::cvtColor(scaled, out, cv::COLOR_BGR2GRAY);
+		else if (scaled.channels() == 4)
+			cv::cvtColor(scaled, out, cv::COLOR_BGRA2GRAY);
+		else
+			scaled.copyTo(out);
+	}
+
 	template<typename T, typename X> //X,Y MAGNITUDE, ANGLE
 	cv::Vec4f analyseData(T*& motion_points, X*& motion_info, int size) {
 		cv::Point2f average_point, point_sum(0, 0);
@@ -62,6 +88,26 @@ namespace Util {
 		return cv::Vec4f(average_point.x, average_point.y, average_magnitude, average_angle);
 	}
 
+	//Same averages for a motion field, angle and magnitude are derived here if nothing has asked for them yet
+	cv::Vec4f analyseData(const MotionField& field) {
+		const float * angles = field.GetAngles();
+		const float * magnitudes = field.GetMagnitudes();
+		int size = field.GetCount();
+
+		cv::Point2f point_sum(0, 0);
+		double magnitude_sum = 0, angle_sum = 0;
+
+		for (int i = 0; i < size; ++i) {
+			cv::Point p = field.GetRefPoint(i);
+			point_sum += cv::Point2f(p.x, p.y);
+			angle_sum += angles[i];
+			magnitude_sum += magnitudes[i];
+		}
+
+		cv::Point2f average_point = point_sum / size;
+		return cv::Vec4f(average_point.x, average_point.y, magnitude_sum / size, angle_sum / size);
+	}
+
 	cv::Point down_point(0, 0), up_point(0, 0);
 	bool down = false, up = false, roi_done = false;
 